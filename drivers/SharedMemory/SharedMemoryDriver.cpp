@@ -0,0 +1,382 @@
+// OpenNI2 driver that exposes the frames a SharedFramePublisher writes to
+// shared memory as a regular device, so any OpenNI application (NiViewer,
+// recorders, third party trackers) can attach to a sensor another process
+// has opened, without it being opened twice.
+//
+// Build it as a shared library and copy it next to OpenNI2's other drivers
+// (OpenNI2/Drivers), e.g. on Linux:
+//
+//     c++ -O2 -std=gnu++11 -shared -fPIC -I../../include -I../../include/OpenNI2
+//         -I../../include/OpenNI2/Driver -o libSharedMemoryDriver.so
+//         SharedMemoryDriver.cpp -pthread -lrt
+//
+// Devices are opened by the name the frames are published under:
+//
+//     shm://kinect
+//
+// Only the streams being published show up as sensors. Frames are copied
+// out of the ring once per frame, so they stay valid for as long as OpenNI
+// holds them.
+
+#include "OniDriverAPI.h"
+#include "CinderOpenNI/SharedFrameRing.h"
+
+#if defined( _WIN32 )
+#   error "The shared memory rings are POSIX only"
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#if !defined( XN_NEW )
+#   define XN_NEW( type, arg ) new type( arg )
+#   define XN_DELETE( p ) delete ( p )
+#endif
+
+namespace sharedmemory {
+    using cinder::openni::SharedFrameRing;
+    using cinder::openni::SharedFrameView;
+    using cinder::openni::SharedRingHeader;
+
+    static const char *URI_PREFIX = "shm://";
+    // how often a stream looks for new frames
+    static const int POLL_INTERVAL_US = 500;
+
+    // The publisher name in \a uri, e.g. "kinect" for shm://kinect.
+    static std::string getPublisherName( const char *uri )
+    {
+        std::string name( uri + std::strlen( URI_PREFIX ) );
+        size_t end = name.find( '?' );
+        return end == std::string::npos ? name : name.substr( 0, end );
+    }
+
+    // The video mode and properties of a published stream, read from its ring
+    // when the device is opened.
+    struct StreamFormat {
+        OniSensorType sensorType;
+        OniVideoMode videoMode;
+        int maxValue;
+        float horizontalFov, verticalFov;
+        std::string ringName;
+
+        // Returns false if nothing is published as \a ringName.
+        bool read( const std::string &_ringName )
+        {
+            SharedFrameRing ring;
+            if ( !ring.open( _ringName ) ) return false;
+
+            const SharedRingHeader &header = ring.getHeader();
+            sensorType = (OniSensorType)header.sensorType;
+            videoMode.pixelFormat = (OniPixelFormat)header.pixelFormat;
+            videoMode.resolutionX = header.width;
+            videoMode.resolutionY = header.height;
+            videoMode.fps = header.fps;
+            maxValue = header.maxValue;
+            horizontalFov = header.horizontalFov;
+            verticalFov = header.verticalFov;
+            ringName = _ringName;
+            return true;
+        }
+    };
+
+    // Frames are reference counted through pDriverCookie and freed when
+    // the last reference is released.
+    struct FrameAllocation {
+        OniDriverFrame frame;
+        std::atomic< int > refCount;
+    };
+
+    class SharedMemoryStream : public oni::driver::StreamBase {
+    public:
+        SharedMemoryStream( const StreamFormat &format ) :
+        format( format ),
+        isRunning( false )
+        {
+        }
+
+        ~SharedMemoryStream()
+        {
+            stop();
+        }
+
+        OniStatus start()
+        {
+            if ( isRunning ) return ONI_STATUS_OK;
+
+            isRunning = true;
+            thread = std::thread( &SharedMemoryStream::run, this );
+            return ONI_STATUS_OK;
+        }
+
+        void stop()
+        {
+            isRunning = false;
+            if ( thread.joinable() ) thread.join();
+        }
+
+        OniStatus getProperty( int propertyId, void *data, int *pDataSize )
+        {
+            switch ( propertyId ) {
+                case ONI_STREAM_PROPERTY_VIDEO_MODE:
+                    return getValue( format.videoMode, data, pDataSize );
+                case ONI_STREAM_PROPERTY_MAX_VALUE:
+                    return getValue( format.maxValue, data, pDataSize );
+                case ONI_STREAM_PROPERTY_MIN_VALUE:
+                    return getValue( 0, data, pDataSize );
+                case ONI_STREAM_PROPERTY_HORIZONTAL_FOV:
+                    return getValue( format.horizontalFov, data, pDataSize );
+                case ONI_STREAM_PROPERTY_VERTICAL_FOV:
+                    return getValue( format.verticalFov, data, pDataSize );
+                case ONI_STREAM_PROPERTY_STRIDE:
+                    return getValue( format.videoMode.resolutionX * getBytesPerPixel(), data, pDataSize );
+                case ONI_STREAM_PROPERTY_MIRRORING:
+                    return getValue( (OniBool)FALSE, data, pDataSize );
+                default:
+                    return ONI_STATUS_NOT_SUPPORTED;
+            }
+        }
+
+        // The mode is whatever the publisher publishes, it can only be set
+        // to itself.
+        OniStatus setProperty( int propertyId, const void *data, int dataSize )
+        {
+            if ( propertyId != ONI_STREAM_PROPERTY_VIDEO_MODE || dataSize != sizeof( OniVideoMode ) ) return ONI_STATUS_NOT_SUPPORTED;
+
+            const OniVideoMode &mode = *(const OniVideoMode *)data;
+            bool isPublished = mode.pixelFormat == format.videoMode.pixelFormat && mode.resolutionX == format.videoMode.resolutionX
+                               && mode.resolutionY == format.videoMode.resolutionY;
+            return isPublished ? ONI_STATUS_OK : ONI_STATUS_NOT_SUPPORTED;
+        }
+
+        OniBool isPropertySupported( int propertyId )
+        {
+            int size = 0;
+            return getProperty( propertyId, NULL, &size ) != ONI_STATUS_NOT_SUPPORTED;
+        }
+
+        void addRefToFrame( OniDriverFrame *pFrame )
+        {
+            ++( (FrameAllocation *)pFrame->pDriverCookie )->refCount;
+        }
+
+        void releaseFrame( OniDriverFrame *pFrame )
+        {
+            FrameAllocation *allocation = (FrameAllocation *)pFrame->pDriverCookie;
+            if ( --allocation->refCount > 0 ) return;
+
+            delete [] (uint8_t *)allocation->frame.frame.data;
+            delete allocation;
+        }
+
+        // The publisher's registration isn't published, so depth and color
+        // are assumed to cover the same view.
+        OniStatus convertDepthToColorCoordinates( StreamBase *colorStream, int depthX, int depthY, OniDepthPixel, int *pColorX, int *pColorY )
+        {
+            // only maps from a depth stream into one of our color streams
+            const SharedMemoryStream *color = (SharedMemoryStream *)colorStream;
+            if ( format.sensorType != ONI_SENSOR_DEPTH || color == NULL || color->format.sensorType != ONI_SENSOR_COLOR ) return ONI_STATUS_NOT_SUPPORTED;
+
+            const OniVideoMode &colorMode = color->format.videoMode;
+            *pColorX = depthX * colorMode.resolutionX / format.videoMode.resolutionX;
+            *pColorY = depthY * colorMode.resolutionY / format.videoMode.resolutionY;
+            return ONI_STATUS_OK;
+        }
+
+    private:
+        StreamFormat format;
+        std::atomic< bool > isRunning;
+        std::thread thread;
+
+        int getBytesPerPixel() const
+        {
+            return format.sensorType == ONI_SENSOR_DEPTH ? sizeof( OniDepthPixel ) : sizeof( OniRGB888Pixel );
+        }
+
+        // With a NULL \a data only reports whether the property exists.
+        template < typename value_t >
+        static OniStatus getValue( const value_t &value, void *data, int *pDataSize )
+        {
+            if ( data == NULL ) return ONI_STATUS_OK;
+            if ( *pDataSize < (int)sizeof( value_t ) ) return ONI_STATUS_BAD_PARAMETER;
+
+            std::memcpy( data, &value, sizeof( value_t ) );
+            *pDataSize = sizeof( value_t );
+            return ONI_STATUS_OK;
+        }
+
+        void run()
+        {
+            SharedFrameRing ring;
+            uint64_t lastFrameNumber = 0;
+            bool hasFrame = false;
+
+            while ( isRunning ) {
+                std::this_thread::sleep_for( std::chrono::microseconds( POLL_INTERVAL_US ) );
+
+                // the publisher restarted or went away, pick it up again
+                if ( ring.isOpen() && ring.isClosed() ) {
+                    ring.close();
+                    hasFrame = false;
+                }
+                if ( !ring.isOpen() && !ring.open( format.ringName ) ) continue;
+
+                SharedFrameView view;
+                if ( !ring.readLatest( view ) ) continue;
+                if ( hasFrame && view.frameNumber <= lastFrameNumber ) continue;
+                if ( view.width != format.videoMode.resolutionX || view.height != format.videoMode.resolutionY ) continue;
+
+                OniDriverFrame *frame = allocateFrame();
+                std::memcpy( frame->frame.data, view.data, frame->frame.dataSize );
+                // overwritten while copying, the next poll gets a newer one
+                if ( !ring.isIntact( view ) ) {
+                    releaseFrame( frame );
+                    continue;
+                }
+
+                frame->frame.frameIndex = view.frameIndex;
+                frame->frame.timestamp = view.timestamp;
+                lastFrameNumber = view.frameNumber;
+                hasFrame = true;
+
+                raiseNewFrame( frame );
+                releaseFrame( frame );
+            }
+        }
+
+        OniDriverFrame * allocateFrame()
+        {
+            int width = format.videoMode.resolutionX, height = format.videoMode.resolutionY;
+
+            FrameAllocation *allocation = new FrameAllocation();
+            allocation->refCount = 1;
+
+            OniFrame &frame = allocation->frame.frame;
+            frame.dataSize = width * height * getBytesPerPixel();
+            frame.data = new uint8_t[frame.dataSize];
+            frame.sensorType = format.sensorType;
+            frame.width = width;
+            frame.height = height;
+            frame.videoMode = format.videoMode;
+            frame.croppingEnabled = FALSE;
+            frame.cropOriginX = 0;
+            frame.cropOriginY = 0;
+            frame.stride = width * getBytesPerPixel();
+
+            allocation->frame.pDriverCookie = allocation;
+            allocation->frame.pOpenNICookie = NULL;
+            return &allocation->frame;
+        }
+    };
+
+    class SharedMemoryDevice : public oni::driver::DeviceBase {
+    public:
+        SharedMemoryDevice( const std::string &name ) :
+        sensorCount( 0 )
+        {
+            static const char *STREAMS[] = { "depth", "color" };
+            for ( int s = 0; s < 2; ++s ) {
+                StreamFormat &format = formats[sensorCount];
+                if ( !format.read( cinder::openni::getSharedRingName( name, STREAMS[s] ) ) ) continue;
+
+                sensors[sensorCount].sensorType = format.sensorType;
+                sensors[sensorCount].numSupportedVideoModes = 1;
+                sensors[sensorCount].pSupportedVideoModes = &format.videoMode;
+                ++sensorCount;
+            }
+        }
+
+        bool hasSensors() const { return sensorCount > 0; }
+
+        OniStatus getSensorInfoList( OniSensorInfo **pSensorInfos, int *numSensors )
+        {
+            *pSensorInfos = sensors;
+            *numSensors = sensorCount;
+            return ONI_STATUS_OK;
+        }
+
+        oni::driver::StreamBase * createStream( OniSensorType sensorType )
+        {
+            for ( int s = 0; s < sensorCount; ++s ) {
+                if ( formats[s].sensorType == sensorType ) return new SharedMemoryStream( formats[s] );
+            }
+            return NULL;
+        }
+
+        void destroyStream( oni::driver::StreamBase *pStream )
+        {
+            delete pStream;
+        }
+
+        OniStatus getProperty( int propertyId, void *data, int *pDataSize )
+        {
+            if ( propertyId != ONI_DEVICE_PROPERTY_IMAGE_REGISTRATION ) return ONI_STATUS_NOT_SUPPORTED;
+            if ( *pDataSize < (int)sizeof( OniImageRegistrationMode ) ) return ONI_STATUS_BAD_PARAMETER;
+
+            *(OniImageRegistrationMode *)data = ONI_IMAGE_REGISTRATION_OFF;
+            *pDataSize = sizeof( OniImageRegistrationMode );
+            return ONI_STATUS_OK;
+        }
+
+        OniBool isPropertySupported( int propertyId )
+        {
+            return propertyId == ONI_DEVICE_PROPERTY_IMAGE_REGISTRATION;
+        }
+
+    private:
+        StreamFormat formats[2];
+        OniSensorInfo sensors[2];
+        int sensorCount;
+    };
+
+    class SharedMemoryDriver : public oni::driver::DriverBase {
+    public:
+        SharedMemoryDriver( OniDriverServices *pDriverServices ) :
+        DriverBase( pDriverServices )
+        {
+        }
+
+        // Publishers come and go, so nothing is announced up front. Opening
+        // a shm:// URI makes OpenNI ask every driver to try it.
+        OniStatus tryDevice( const char *uri )
+        {
+            if ( std::strncmp( uri, URI_PREFIX, std::strlen( URI_PREFIX ) ) != 0 ) return ONI_STATUS_ERROR;
+
+            SharedMemoryDevice probe( getPublisherName( uri ) );
+            if ( !probe.hasSensors() ) return ONI_STATUS_ERROR;
+
+            OniDeviceInfo info;
+            std::memset( &info, 0, sizeof( info ) );
+            std::strncpy( info.uri, uri, ONI_MAX_STR - 1 );
+            std::strncpy( info.vendor, "Cinder-OpenNI", ONI_MAX_STR - 1 );
+            std::strncpy( info.name, "Shared memory", ONI_MAX_STR - 1 );
+            deviceConnected( &info );
+            return ONI_STATUS_OK;
+        }
+
+        oni::driver::DeviceBase * deviceOpen( const char *uri )
+        {
+            if ( std::strncmp( uri, URI_PREFIX, std::strlen( URI_PREFIX ) ) != 0 ) return NULL;
+
+            SharedMemoryDevice *device = new SharedMemoryDevice( getPublisherName( uri ) );
+            if ( device->hasSensors() ) return device;
+
+            delete device;
+            return NULL;
+        }
+
+        void deviceClose( oni::driver::DeviceBase *pDevice )
+        {
+            delete pDevice;
+        }
+
+        void shutdown()
+        {
+        }
+    };
+}
+
+ONI_EXPORT_DRIVER( sharedmemory::SharedMemoryDriver );
@@ -0,0 +1,456 @@
+// OpenNI2 driver that renders depth and color frames of a simple moving
+// scene, so the block can be benchmarked and tested without a sensor.
+//
+// Build it as a shared library and copy it next to OpenNI2's other drivers
+// (OpenNI2/Drivers), e.g. on Linux:
+//
+//     c++ -O2 -std=gnu++11 -shared -fPIC -I../../include/OpenNI2
+//         -I../../include/OpenNI2/Driver -o libSyntheticDriver.so
+//         SyntheticDriver.cpp -pthread
+//
+// Devices are opened by URI, with optional parameters:
+//
+//     synthetic://?width=640&height=480&fps=30&noise=0
+//
+// fps=0 renders frames as fast as the machine can. noise adds up to that
+// many millimeters of random error to every depth pixel.
+
+#include "OniDriverAPI.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#if !defined( XN_NEW )
+#   define XN_NEW( type, arg ) new type( arg )
+#   define XN_DELETE( p ) delete ( p )
+#endif
+
+namespace synthetic {
+    static const char *URI_PREFIX = "synthetic://";
+    static const int MAX_DEPTH = 10000;
+    // a Kinect's field of view
+    static const float HORIZONTAL_FOV = 1.0144f;
+    static const float VERTICAL_FOV = 0.7898f;
+
+    struct Settings {
+        int width, height, fps, noise;
+
+        Settings() : width( 640 ), height( 480 ), fps( 30 ), noise( 0 ) {}
+
+        // Reads key=value pairs after the '?' of \a uri, ignoring unknown keys.
+        void parse( const std::string &uri )
+        {
+            size_t pos = uri.find( '?' );
+            while ( pos != std::string::npos ) {
+                size_t end = uri.find( '&', pos + 1 );
+                std::string pair = uri.substr( pos + 1, end == std::string::npos ? std::string::npos : end - pos - 1 );
+                size_t equals = pair.find( '=' );
+                if ( equals != std::string::npos ) {
+                    std::string key = pair.substr( 0, equals );
+                    int value = std::atoi( pair.c_str() + equals + 1 );
+                    if ( key == "width" && value > 0 ) width = value;
+                    else if ( key == "height" && value > 0 ) height = value;
+                    else if ( key == "fps" && value >= 0 ) fps = value;
+                    else if ( key == "noise" && value >= 0 ) noise = value;
+                }
+                pos = end;
+            }
+        }
+    };
+
+    // Where the scene's objects are at time \a t, in seconds. Depth and color
+    // render the same scene from the same viewpoint, so they line up.
+    struct Scene {
+        // sphere center in normalized image coordinates, radius in image
+        // heights, depth in mm
+        float sphereX, sphereY, sphereRadius, sphereZ;
+        // box corners in normalized image coordinates, depth in mm
+        float boxLeft, boxTop, boxRight, boxBottom, boxZ;
+
+        Scene( double t )
+        {
+            sphereX = 0.5f + 0.3f * (float)std::sin( t * 0.9 );
+            sphereY = 0.5f + 0.2f * (float)std::sin( t * 1.3 );
+            sphereRadius = 0.15f;
+            sphereZ = 1500.0f + 500.0f * (float)std::sin( t * 0.5 );
+
+            float boxX = 0.5f + 0.35f * (float)std::cos( t * 0.7 );
+            boxLeft = boxX - 0.1f;
+            boxRight = boxX + 0.1f;
+            boxTop = 0.6f;
+            boxBottom = 0.9f;
+            boxZ = 2200.0f;
+        }
+    };
+
+    // Frames are reference counted through pDriverCookie and freed when
+    // the last reference is released.
+    struct FrameAllocation {
+        OniDriverFrame frame;
+        std::atomic< int > refCount;
+    };
+
+    class SyntheticStream : public oni::driver::StreamBase {
+    public:
+        SyntheticStream( OniSensorType sensorType, const Settings &settings ) :
+        sensorType( sensorType ),
+        isRunning( false ),
+        frameIndex( 0 ),
+        noiseState( 0x9E3779B9u )
+        {
+            videoMode.pixelFormat = sensorType == ONI_SENSOR_DEPTH ? ONI_PIXEL_FORMAT_DEPTH_1_MM : ONI_PIXEL_FORMAT_RGB888;
+            videoMode.resolutionX = settings.width;
+            videoMode.resolutionY = settings.height;
+            videoMode.fps = settings.fps;
+            noise = settings.noise;
+        }
+
+        ~SyntheticStream()
+        {
+            stop();
+        }
+
+        OniStatus start()
+        {
+            if ( isRunning ) return ONI_STATUS_OK;
+
+            isRunning = true;
+            thread = std::thread( &SyntheticStream::run, this );
+            return ONI_STATUS_OK;
+        }
+
+        void stop()
+        {
+            isRunning = false;
+            if ( thread.joinable() ) thread.join();
+        }
+
+        OniStatus getProperty( int propertyId, void *data, int *pDataSize )
+        {
+            switch ( propertyId ) {
+                case ONI_STREAM_PROPERTY_VIDEO_MODE:
+                    return getValue( videoMode, data, pDataSize );
+                case ONI_STREAM_PROPERTY_MAX_VALUE:
+                    return getValue( sensorType == ONI_SENSOR_DEPTH ? MAX_DEPTH : 255, data, pDataSize );
+                case ONI_STREAM_PROPERTY_MIN_VALUE:
+                    return getValue( 0, data, pDataSize );
+                case ONI_STREAM_PROPERTY_HORIZONTAL_FOV:
+                    return getValue( HORIZONTAL_FOV, data, pDataSize );
+                case ONI_STREAM_PROPERTY_VERTICAL_FOV:
+                    return getValue( VERTICAL_FOV, data, pDataSize );
+                case ONI_STREAM_PROPERTY_STRIDE:
+                    return getValue( videoMode.resolutionX * getBytesPerPixel(), data, pDataSize );
+                case ONI_STREAM_PROPERTY_MIRRORING:
+                    return getValue( (OniBool)FALSE, data, pDataSize );
+                default:
+                    return ONI_STATUS_NOT_SUPPORTED;
+            }
+        }
+
+        OniStatus setProperty( int propertyId, const void *data, int dataSize )
+        {
+            if ( propertyId != ONI_STREAM_PROPERTY_VIDEO_MODE || dataSize != sizeof( OniVideoMode ) ) return ONI_STATUS_NOT_SUPPORTED;
+
+            const OniVideoMode &mode = *(const OniVideoMode *)data;
+            if ( mode.pixelFormat != videoMode.pixelFormat || mode.resolutionX <= 0 || mode.resolutionY <= 0 ) return ONI_STATUS_BAD_PARAMETER;
+            if ( isRunning ) return ONI_STATUS_OUT_OF_FLOW;
+
+            videoMode = mode;
+            return ONI_STATUS_OK;
+        }
+
+        OniBool isPropertySupported( int propertyId )
+        {
+            int size = 0;
+            return getProperty( propertyId, NULL, &size ) != ONI_STATUS_NOT_SUPPORTED;
+        }
+
+        void addRefToFrame( OniDriverFrame *pFrame )
+        {
+            ++( (FrameAllocation *)pFrame->pDriverCookie )->refCount;
+        }
+
+        void releaseFrame( OniDriverFrame *pFrame )
+        {
+            FrameAllocation *allocation = (FrameAllocation *)pFrame->pDriverCookie;
+            if ( --allocation->refCount > 0 ) return;
+
+            delete [] (uint8_t *)allocation->frame.frame.data;
+            delete allocation;
+        }
+
+        // Both streams are rendered from the same viewpoint.
+        OniStatus convertDepthToColorCoordinates( StreamBase *colorStream, int depthX, int depthY, OniDepthPixel, int *pColorX, int *pColorY )
+        {
+            // only maps from a depth stream into one of our color streams
+            const SyntheticStream *color = (SyntheticStream *)colorStream;
+            if ( sensorType != ONI_SENSOR_DEPTH || color == NULL || color->sensorType != ONI_SENSOR_COLOR ) return ONI_STATUS_NOT_SUPPORTED;
+
+            *pColorX = depthX * color->videoMode.resolutionX / videoMode.resolutionX;
+            *pColorY = depthY * color->videoMode.resolutionY / videoMode.resolutionY;
+            return ONI_STATUS_OK;
+        }
+
+    private:
+        OniSensorType sensorType;
+        OniVideoMode videoMode;
+        int noise;
+        std::atomic< bool > isRunning;
+        std::thread thread;
+        int frameIndex;
+        uint32_t noiseState;
+
+        int getBytesPerPixel() const
+        {
+            return sensorType == ONI_SENSOR_DEPTH ? sizeof( OniDepthPixel ) : sizeof( OniRGB888Pixel );
+        }
+
+        // With a NULL \a data only reports whether the property exists.
+        template < typename value_t >
+        static OniStatus getValue( const value_t &value, void *data, int *pDataSize )
+        {
+            if ( data == NULL ) return ONI_STATUS_OK;
+            if ( *pDataSize < (int)sizeof( value_t ) ) return ONI_STATUS_BAD_PARAMETER;
+
+            std::memcpy( data, &value, sizeof( value_t ) );
+            *pDataSize = sizeof( value_t );
+            return ONI_STATUS_OK;
+        }
+
+        void run()
+        {
+            typedef std::chrono::steady_clock clock;
+            clock::time_point start = clock::now(), next = start;
+
+            while ( isRunning ) {
+                if ( videoMode.fps > 0 ) {
+                    next += std::chrono::microseconds( 1000000 / videoMode.fps );
+                    std::this_thread::sleep_until( next );
+                }
+
+                OniDriverFrame *frame = allocateFrame();
+                frame->frame.frameIndex = ++frameIndex;
+                frame->frame.timestamp = std::chrono::duration_cast< std::chrono::microseconds >( clock::now() - start ).count();
+
+                // unthrottled streams still animate at 30fps worth of motion
+                // per frame, so the output doesn't depend on the machine
+                Scene scene( frameIndex / (double)( videoMode.fps > 0 ? videoMode.fps : 30 ) );
+                if ( sensorType == ONI_SENSOR_DEPTH ) renderDepth( scene, (OniDepthPixel *)frame->frame.data );
+                else renderColor( scene, (OniRGB888Pixel *)frame->frame.data );
+
+                raiseNewFrame( frame );
+                releaseFrame( frame );
+            }
+        }
+
+        OniDriverFrame * allocateFrame()
+        {
+            int width = videoMode.resolutionX, height = videoMode.resolutionY;
+
+            FrameAllocation *allocation = new FrameAllocation();
+            allocation->refCount = 1;
+
+            OniFrame &frame = allocation->frame.frame;
+            frame.dataSize = width * height * getBytesPerPixel();
+            frame.data = new uint8_t[frame.dataSize];
+            frame.sensorType = sensorType;
+            frame.width = width;
+            frame.height = height;
+            frame.videoMode = videoMode;
+            frame.croppingEnabled = FALSE;
+            frame.cropOriginX = 0;
+            frame.cropOriginY = 0;
+            frame.stride = width * getBytesPerPixel();
+
+            allocation->frame.pDriverCookie = allocation;
+            allocation->frame.pOpenNICookie = NULL;
+            return &allocation->frame;
+        }
+
+        // xorshift32, cheap enough to run per pixel
+        int nextNoise()
+        {
+            noiseState ^= noiseState << 13;
+            noiseState ^= noiseState >> 17;
+            noiseState ^= noiseState << 5;
+            return (int)( noiseState % ( 2 * noise + 1 ) ) - noise;
+        }
+
+        void renderDepth( const Scene &scene, OniDepthPixel *depth )
+        {
+            int width = videoMode.resolutionX, height = videoMode.resolutionY;
+            float radius = scene.sphereRadius * height;
+            float sphereX = scene.sphereX * width, sphereY = scene.sphereY * height;
+
+            for ( int y = 0; y < height; ++y ) {
+                float v = (float)y / height;
+                // floor toward the bottom, back wall above it
+                float background = v > 0.55f ? 4000.0f - ( v - 0.55f ) * 5000.0f : 4000.0f;
+                bool isBoxRow = v >= scene.boxTop && v < scene.boxBottom;
+
+                for ( int x = 0; x < width; ++x ) {
+                    float u = (float)x / width;
+                    float z = background;
+                    if ( isBoxRow && u >= scene.boxLeft && u < scene.boxRight ) z = scene.boxZ;
+
+                    float dx = x - sphereX, dy = y - sphereY;
+                    float distance2 = dx * dx + dy * dy;
+                    if ( distance2 < radius * radius ) {
+                        float sphereZ = scene.sphereZ - std::sqrt( radius * radius - distance2 ) / radius * 200.0f;
+                        if ( sphereZ < z ) z = sphereZ;
+                    }
+
+                    int value = (int)z;
+                    if ( noise > 0 ) value += nextNoise();
+                    depth[y * width + x] = (OniDepthPixel)( value < 0 ? 0 : value > MAX_DEPTH ? MAX_DEPTH : value );
+                }
+            }
+        }
+
+        void renderColor( const Scene &scene, OniRGB888Pixel *color )
+        {
+            int width = videoMode.resolutionX, height = videoMode.resolutionY;
+            float radius = scene.sphereRadius * height;
+            float sphereX = scene.sphereX * width, sphereY = scene.sphereY * height;
+
+            for ( int y = 0; y < height; ++y ) {
+                float v = (float)y / height;
+                bool isBoxRow = v >= scene.boxTop && v < scene.boxBottom;
+
+                for ( int x = 0; x < width; ++x ) {
+                    float u = (float)x / width;
+                    OniRGB888Pixel pixel;
+                    if ( v > 0.55f ) {
+                        pixel.r = pixel.g = pixel.b = (uint8_t)( ( ( x / 32 + y / 32 ) & 1 ) ? 90 : 140 );
+                    }
+                    else {
+                        pixel.r = (uint8_t)( 60 + 100 * u );
+                        pixel.g = (uint8_t)( 80 + 80 * v );
+                        pixel.b = 170;
+                    }
+                    if ( isBoxRow && u >= scene.boxLeft && u < scene.boxRight ) {
+                        pixel.r = 40; pixel.g = 170; pixel.b = 60;
+                    }
+
+                    float dx = x - sphereX, dy = y - sphereY;
+                    if ( dx * dx + dy * dy < radius * radius ) {
+                        pixel.r = 220; pixel.g = 60; pixel.b = 40;
+                    }
+
+                    color[y * width + x] = pixel;
+                }
+            }
+        }
+    };
+
+    class SyntheticDevice : public oni::driver::DeviceBase {
+    public:
+        SyntheticDevice( const Settings &settings ) :
+        settings( settings )
+        {
+            // the URI's mode first, OpenNI opens streams with it
+            static const int WIDTHS[] = { 0, 320, 640 }, HEIGHTS[] = { 0, 240, 480 };
+            for ( int s = 0; s < 2; ++s ) {
+                OniPixelFormat pixelFormat = s == 0 ? ONI_PIXEL_FORMAT_DEPTH_1_MM : ONI_PIXEL_FORMAT_RGB888;
+                for ( int m = 0; m < MODE_COUNT; ++m ) {
+                    OniVideoMode &mode = videoModes[s][m];
+                    mode.pixelFormat = pixelFormat;
+                    mode.resolutionX = m == 0 ? settings.width : WIDTHS[m];
+                    mode.resolutionY = m == 0 ? settings.height : HEIGHTS[m];
+                    mode.fps = settings.fps;
+                }
+                sensors[s].sensorType = s == 0 ? ONI_SENSOR_DEPTH : ONI_SENSOR_COLOR;
+                sensors[s].numSupportedVideoModes = MODE_COUNT;
+                sensors[s].pSupportedVideoModes = videoModes[s];
+            }
+        }
+
+        OniStatus getSensorInfoList( OniSensorInfo **pSensorInfos, int *numSensors )
+        {
+            *pSensorInfos = sensors;
+            *numSensors = 2;
+            return ONI_STATUS_OK;
+        }
+
+        oni::driver::StreamBase * createStream( OniSensorType sensorType )
+        {
+            if ( sensorType != ONI_SENSOR_DEPTH && sensorType != ONI_SENSOR_COLOR ) return NULL;
+            return new SyntheticStream( sensorType, settings );
+        }
+
+        void destroyStream( oni::driver::StreamBase *pStream )
+        {
+            delete pStream;
+        }
+
+        OniStatus getProperty( int propertyId, void *data, int *pDataSize )
+        {
+            if ( propertyId != ONI_DEVICE_PROPERTY_IMAGE_REGISTRATION ) return ONI_STATUS_NOT_SUPPORTED;
+            if ( *pDataSize < (int)sizeof( OniImageRegistrationMode ) ) return ONI_STATUS_BAD_PARAMETER;
+
+            *(OniImageRegistrationMode *)data = ONI_IMAGE_REGISTRATION_OFF;
+            *pDataSize = sizeof( OniImageRegistrationMode );
+            return ONI_STATUS_OK;
+        }
+
+        OniBool isPropertySupported( int propertyId )
+        {
+            return propertyId == ONI_DEVICE_PROPERTY_IMAGE_REGISTRATION;
+        }
+
+    private:
+        enum { MODE_COUNT = 3 };
+        Settings settings;
+        OniSensorInfo sensors[2];
+        OniVideoMode videoModes[2][MODE_COUNT];
+    };
+
+    class SyntheticDriver : public oni::driver::DriverBase {
+    public:
+        SyntheticDriver( OniDriverServices *pDriverServices ) :
+        DriverBase( pDriverServices )
+        {
+        }
+
+        // Nothing is announced up front, so an installed synthetic driver
+        // never stands in for a real device. Opening a synthetic:// URI
+        // makes OpenNI ask every driver to try it.
+        OniStatus tryDevice( const char *uri )
+        {
+            if ( std::strncmp( uri, URI_PREFIX, std::strlen( URI_PREFIX ) ) != 0 ) return ONI_STATUS_ERROR;
+
+            OniDeviceInfo info;
+            std::memset( &info, 0, sizeof( info ) );
+            std::strncpy( info.uri, uri, ONI_MAX_STR - 1 );
+            std::strncpy( info.vendor, "Cinder-OpenNI", ONI_MAX_STR - 1 );
+            std::strncpy( info.name, "Synthetic", ONI_MAX_STR - 1 );
+            deviceConnected( &info );
+            return ONI_STATUS_OK;
+        }
+
+        oni::driver::DeviceBase * deviceOpen( const char *uri )
+        {
+            if ( std::strncmp( uri, URI_PREFIX, std::strlen( URI_PREFIX ) ) != 0 ) return NULL;
+
+            Settings settings;
+            settings.parse( uri );
+            return new SyntheticDevice( settings );
+        }
+
+        void deviceClose( oni::driver::DeviceBase *pDevice )
+        {
+            delete pDevice;
+        }
+
+        void shutdown()
+        {
+        }
+    };
+}
+
+ONI_EXPORT_DRIVER( synthetic::SyntheticDriver );
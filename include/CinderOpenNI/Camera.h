@@ -1,91 +1,75 @@
 #pragma once
 
 #include "cinder/gl/Texture.h"
+#include "CinderOpenNI/CameraCore.h"
 
 namespace cinder {
     namespace openni {
-        class Camera {
+        //! CameraCore plus textures of the current frames, for apps with a
+        //! GL context.
+        class Camera : public CameraCore {
         public:
             Camera();
-            ~Camera();
 
-            static bool initialized;
-            static void initialize();
-            static void shutdown();
-
-            void setup(int enableSensors=SENSOR_DEPTH|SENSOR_COLOR);
-            void update();
-            void close();
-
-            ImageSourceRef getDepthImage();
-            ImageSourceRef getRawDepthImage();
-            ImageSourceRef getColorImage();
             gl::Texture & getDepthTex();
+            //! Single channel, 16 bit normalized texture (R16 where the GL
+            //! supports it) uploaded straight from the depth frame.
             gl::Texture & getRawDepthTex();
             gl::Texture & getColorTex();
-            Vec2i getDepthSize(){ return getFrameData( depthIndex ).size; }
-            Vec2i getColorSize(){ return getFrameData( colorIndex ).size; }
-
-            enum SENSORS {
-                SENSOR_DEPTH = 0x1,
-                SENSOR_COLOR = 0x2
-            };
+            //! getFilteredDepthChannel16u() as a texture, in the format of
+            //! getRawDepthTex().
+            gl::Texture & getFilteredDepthTex();
+            //! getCleanDepthChannel16u() as a texture, in the format of
+            //! getRawDepthTex().
+            gl::Texture & getCleanDepthTex();
+
+            //! Streams texture uploads through a pair of pixel buffer
+            //! objects instead of uploading straight from client memory.
+            void setPboEnabled( bool enabled );
+
+            //! Also forgets the textures, so the next device's frames are
+            //! uploaded from scratch.
+            void close();
 
-			class CameraException : public std::exception {
-			};
         private:
-
-            _openni::Device device;
-            _openni::VideoStream depthStream, colorStream;
-            int depthIndex, colorIndex;
-
-            class FrameDataAbstract {
+            class TexData {
             public:
-                FrameDataAbstract( Vec2i size );
+                TexData();
+                ~TexData();
 
-                Vec2i size;
-                gl::Texture tex;
-                ImageSourceRef imageRef;
-                bool isImageFresh, isTexFresh;
-                void initTexture( Vec2i size );
-            };
+                struct TexFormat {
+                    GLenum format, type;
+                    GLint internalFormat;
+                    int bytesPerPixel;
+                };
+                template < typename pixel_t >
+                static TexFormat getTexFormat();
 
-            class FrameData : public FrameDataAbstract {
-            public:
-                FrameData( _openni::VideoStream &stream, Vec2i size );
-
-                _openni::VideoStream &stream;
-                _openni::VideoFrameRef frameRef;
-
-                template < typename pixel_t, typename image_t >
-                void updateImage();
-                template < typename pixel_t, typename image_t >
-                void updateTex();
-            };
-
-            class DerivedFrameData : public FrameDataAbstract {
-            public:
-                DerivedFrameData();
-                ~DerivedFrameData();
-
-                void updateOriginal( FrameData *_original );
-                template < typename pixel_t, typename image_t, typename original_pixel_t >
-                void updateImage();
-                template < typename pixel_t, typename image_t, typename original_pixel_t >
-                void updateTex();
-            private:
-                void convertData( const _openni::DepthPixel *originalData, uint8_t **convertedData );
-                FrameData *original;
-                uint8_t *convertedData;
+                gl::Texture tex;
+                GLint texInternalFormat;
+                //! generation of the frame data last uploaded
+                uint64_t generation;
+                bool usePbo;
+                GLuint pbos[2];
+                int pboIndex;
+                //! Drops the texture and its generation, keeps the PBOs.
+                void reset();
+                void allocateTex( Vec2i size, const TexFormat &texFormat );
+                //! Updates tex in place, only reallocating it when the size
+                //! or format changed.
+                void uploadTex( Vec2i size, const void *data, int strideInBytes, const TexFormat &texFormat );
             };
 
-            std::vector< FrameData > all;
-            _openni::VideoStream  **allStreams;
-            DerivedFrameData scaledDepthFrameData;
+            std::vector< std::shared_ptr< TexData > > streamTexes;
+            TexData scaledDepthTex, filteredDepthTex, cleanDepthTex;
+            bool usePbo;
 
-            int setupStream( _openni::VideoStream &stream, _openni::SensorType sensorType );
-            void updateStream( int streamIndex );
-            FrameData & getFrameData( int index );
+            template < typename pixel_t >
+            gl::Texture & updateStreamTex( int streamIndex );
+            template < typename filter_t >
+            gl::Texture & updateFilteredTex( FilteredFrameData< filter_t > &frame, TexData &texData );
         };
+
+        typedef std::shared_ptr< Camera > CameraRef;
     }
-}
\ No newline at end of file
+}
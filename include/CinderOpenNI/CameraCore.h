@@ -0,0 +1,483 @@
+#pragma once
+
+#include "cinder/Surface.h"
+#include "cinder/Channel.h"
+#include "cinder/Thread.h"
+#include "CinderOpenNI/ImageSource.h"
+#include "CinderOpenNI/TripleBuffer.h"
+#include "CinderOpenNI/FrameEvent.h"
+#include "CinderOpenNI/DepthVisualizer.h"
+#include "CinderOpenNI/DerivedNode.h"
+#include "CinderOpenNI/PointCloud.h"
+#include "CinderOpenNI/Parallel.h"
+#include "CinderOpenNI/Registration.h"
+#include "CinderOpenNI/SpatialFilter.h"
+#include "CinderOpenNI/Stats.h"
+#include "CinderOpenNI/TemporalFilter.h"
+#include <atomic>
+#include <ostream>
+
+namespace cinder {
+    namespace openni {
+        //! Capture, frame buffering and CPU processing, without any GL or
+        //! app dependency, so it can run in headless processes. Camera adds
+        //! the texture getters on top.
+        class CameraCore {
+        public:
+            CameraCore();
+            virtual ~CameraCore();
+
+            static bool initialized;
+            static void initialize();
+            static void shutdown();
+
+            //! Where errors and warnings go, std::cerr unless set. Camera
+            //! defaults it to app::console().
+            static void setLogStream( std::ostream &stream );
+            static std::ostream & log();
+
+            //! Every device (or .oni recording) OpenNI can currently open.
+            static std::vector< _openni::DeviceInfo > enumerateDevices();
+
+            //! Opens the first available device.
+            void setup(int enableSensors=SENSOR_DEPTH|SENSOR_COLOR, int captureMode=CAPTURE_BLOCKING);
+            //! Opens a device by URI, as reported by enumerateDevices(), or
+            //! an .oni file by path.
+            void setup(const std::string &uri, int enableSensors=SENSOR_DEPTH|SENSOR_COLOR, int captureMode=CAPTURE_BLOCKING);
+            //! Publishes new frames. In CAPTURE_BLOCKING mode waits up to
+            //! \a timeoutMs for a stream to have data (forever by default),
+            //! CAPTURE_POLL never waits, the other modes return immediately.
+            //! Every stream that has a frame ready is read, not just the
+            //! first one. Returns true if a new frame was published.
+            bool update( int timeoutMs=_openni::TIMEOUT_FOREVER );
+            virtual void close();
+
+            ImageSourceRef getDepthImage();
+            ImageSourceRef getRawDepthImage();
+            ImageSourceRef getColorImage();
+            //! Wraps the current depth frame without copying it. The frame
+            //! stays alive for as long as any copy of the channel does.
+            Channel16u getDepthChannel16u();
+            //! Wraps the current color frame without copying it. The frame
+            //! stays alive for as long as any copy of the surface does.
+            Surface8u getColorSurface();
+            bool hasDepth() const { return depthIndex >= 0; }
+            bool hasColor() const { return colorIndex >= 0; }
+            Vec2i getDepthSize(){ return getFrameData( depthIndex ).size; }
+            Vec2i getColorSize(){ return getFrameData( colorIndex ).size; }
+            //! Horizontal and vertical field of view in radians.
+            Vec2f getDepthFieldOfView();
+            Vec2f getColorFieldOfView();
+            struct DepthMetadata {
+                //! largest raw value the depth stream reports
+                uint16_t maxValue;
+                //! raw value * millimetersPerUnit = millimeters
+                float millimetersPerUnit;
+                //! value sampled from Camera::getRawDepthTex() * texScale =
+                //! raw value
+                float texScale;
+            };
+            //! What a shader needs to interpret Camera::getRawDepthTex().
+            DepthMetadata getDepthMetadata();
+
+            struct PointCloudSoA {
+                std::vector< float > x, y, z;
+            };
+            //! World space position of every depth pixel in millimeters, row
+            //! by row. Pixels without depth are at the origin.
+            const std::vector< Vec3f > & getPointCloud();
+            //! Same points as getPointCloud(), one array per coordinate.
+            const PointCloudSoA & getPointCloudSoA();
+            //! Unit surface normal of every point in getPointCloud(), facing
+            //! the camera. Points without a full neighborhood get 0, 0, 0.
+            const std::vector< Vec3f > & getNormals();
+            //! Depth the point cloud and normals are computed from, one of
+            //! DEPTH_SOURCES. DEPTH_RAW by default; DEPTH_CLEAN drops the
+            //! flying pixels that streak across silhouettes.
+            void setPointCloudSource( int source );
+            int getPointCloudSource() const { return pointCloudSource; }
+            //! Threads used for CPU processing such as point clouds,
+            //! including the calling thread. 1 (the default) keeps all work on
+            //! the caller, 0 uses every core.
+            void setProcessingThreads( size_t count );
+
+            //! Depth warped into the color camera's view, at color
+            //! resolution, for drivers that can't register in hardware. The
+            //! tables are built from the driver's CoordinateConverter on the
+            //! first call after a video mode change, unless set with
+            //! setDepthRegistration(). The channel is reused, copy it to keep
+            //! a frame past the next update().
+            Channel16u getRegisteredDepthChannel();
+            //! Replaces the generated tables, e.g. with ones read from a
+            //! Kinect through libfreenect.
+            void setDepthRegistration( const DepthRegistration &registration );
+
+            //! Raw depth smoothed over time by getTemporalFilter(). The filter
+            //! only runs when one of these is asked for, so it sees the frames
+            //! published while they are being used. The channel is updated
+            //! in place, copy it to keep a frame past the next update().
+            ImageSourceRef getFilteredDepthImage();
+            Channel16u getFilteredDepthChannel16u();
+            //! Mode and thresholds of the filter behind
+            //! getFilteredDepthImage() and Camera::getFilteredDepthTex().
+            TemporalDepthFilter & getTemporalFilter(){ return temporalDepthFrameData.filter; }
+
+            //! Raw depth with flying pixels removed, small holes filled and
+            //! surfaces smoothed by getSpatialFilter(), e.g. for point clouds
+            //! and meshes. Computed when asked for, on the processing threads.
+            //! The channel is updated in place.
+            ImageSourceRef getCleanDepthImage();
+            Channel16u getCleanDepthChannel16u();
+            //! Stages and thresholds of the filter behind
+            //! getCleanDepthImage() and Camera::getCleanDepthTex().
+            SpatialDepthFilter & getSpatialFilter(){ return cleanDepthFrameData.filter; }
+
+            //! Range, gamma and colormap used by getDepthImage() and
+            //! Camera::getDepthTex().
+            DepthVisualizer & getDepthVisualizer(){ return scaledDepthFrameData.visualizer; }
+            //! Only publish depth and color together, as the newest pair
+            //! whose timestamps are at most \a toleranceUs apart. Also turns
+            //! on the device's own depth/color sync where supported. update()
+            //! then only returns true when it published a new pair.
+            void setSyncEnabled( bool enabled, uint64_t toleranceUs=16000 );
+            bool isSyncEnabled() const { return syncEnabled; }
+
+            //! Calls \a callback with every new depth frame as soon as it has
+            //! been read, on the reading thread (DISPATCH_INLINE) or on a
+            //! worker thread (DISPATCH_WORKER). Callbacks stay registered
+            //! across close() and setup(), and may add and remove callbacks,
+            //! including themselves.
+            //! Ids start at 1, so 0 can stand for no callback.
+            CallbackId onDepthFrame( FrameCallback callback, int dispatchMode=DISPATCH_INLINE );
+            CallbackId onColorFrame( FrameCallback callback, int dispatchMode=DISPATCH_INLINE );
+            //! Once this returns the callback isn't running on another thread
+            //! and won't be called again, not even for frames already queued
+            //! for the worker.
+            void removeFrameCallback( CallbackId id );
+
+            struct StallEvent {
+                _openni::SensorType sensorType;
+                //! since the stream's last frame
+                uint32_t stalledMs;
+                //! the stream is restarted right after the callback
+                bool isRestarting;
+            };
+            typedef std::function< void ( const StallEvent & ) > StallCallback;
+            //! Watches for streams that haven't delivered a frame for
+            //! \a stallMs, checked on every update() and every \a stallMs
+            //! while update() waits for frames. Stalled streams raise
+            //! the stall callback once per stall and, with STALL_RESTART, are
+            //! stopped and started again. 0 turns the watchdog off.
+            void setStallTimeout( int stallMs, int stallAction=STALL_NOTIFY );
+            //! Called from update() on the updating thread.
+            void onStall( StallCallback callback ){ stallCallback = callback; }
+
+            //! Latencies and durations are in microseconds.
+            struct StreamStats {
+                uint64_t framesRead;
+                //! gaps in the driver's frame indices
+                uint64_t framesDropped;
+                //! frames update() published
+                uint64_t framesConsumed;
+                //! frames read but replaced by a newer one before update()
+                //! got to them
+                uint64_t framesSkipped;
+                //! times the watchdog found the stream stalled
+                uint64_t stalls;
+                //! device timestamp to readFrame() returning, above the
+                //! shortest delay seen so far, as device and host clocks
+                //! don't share an origin
+                Percentiles deviceToRead;
+                Percentiles readDuration;
+                //! readFrame() returning to update() publishing the frame
+                Percentiles readToPublish;
+                //! readFrame() returning to the frame's texture upload
+                Percentiles readToTexture;
+            };
+            struct Stats {
+                StreamStats depth, color;
+                //! time spent in each processing stage, per frame processed
+                Percentiles depthConversion, temporalFilter, spatialFilter, pointCloud, registration, textureUpload;
+            };
+            //! Rolling percentiles over the last RollingSamples::CAPACITY
+            //! frames. Recording them is lock-free; this copies and sorts,
+            //! so call it when you display or log stats, not per frame.
+            Stats getStats() const;
+
+            enum SENSORS {
+                SENSOR_DEPTH = 0x1,
+                SENSOR_COLOR = 0x2
+            };
+
+            enum CAPTURE_MODES {
+                //! update() waits for and reads a frame on the calling thread
+                CAPTURE_BLOCKING,
+                //! a background thread reads every stream, update() only
+                //! publishes the latest frames
+                CAPTURE_THREADED,
+                //! frames are read by OpenNI's NewFrameListener the moment the
+                //! driver delivers them, update() only publishes them
+                CAPTURE_LISTENER,
+                //! like CAPTURE_BLOCKING, but update() only reads streams
+                //! that already have data and never waits
+                CAPTURE_POLL
+            };
+
+            enum STALL_ACTIONS {
+                STALL_NOTIFY,
+                STALL_RESTART
+            };
+
+            enum DEPTH_SOURCES {
+                //! the depth frame as read
+                DEPTH_RAW,
+                //! getFilteredDepthChannel16u()
+                DEPTH_FILTERED,
+                //! getCleanDepthChannel16u()
+                DEPTH_CLEAN
+            };
+
+            enum DISPATCH_MODES {
+                DISPATCH_INLINE,
+                DISPATCH_WORKER
+            };
+
+			class CameraException : public std::exception {
+			};
+        protected:
+
+            _openni::Device device;
+            _openni::VideoStream depthStream, colorStream;
+            int depthIndex, colorIndex;
+
+            //! A node in the graph of frames and products derived from
+            //! them. Its generation is bumped whenever the data behind it
+            //! changes, so layers on top (images, textures) know when to
+            //! refresh.
+            class FrameDataAbstract : public DerivedNode {
+            public:
+                FrameDataAbstract( Vec2i size );
+
+                Vec2i size;
+                ImageSourceRef imageRef;
+                //! generation imageRef was made from
+                uint64_t imageGeneration;
+                bool isImageFresh() const { return imageGeneration == getGeneration(); }
+                void initImage( Vec2i size );
+
+                //! Image sources handed out recently. One nobody else holds
+                //! any more is pointed at the next frame instead of
+                //! allocating a new one, so the steady state doesn't allocate
+                //! unless callers keep every image around.
+                enum { IMAGE_POOL_SIZE = 3 };
+                ImageSourceRef imagePool[IMAGE_POOL_SIZE];
+                int imagePoolNext;
+                template < typename image_t >
+                std::shared_ptr< image_t > reuseImage();
+                void keepImage( const ImageSourceRef &image );
+            };
+
+            struct CapturedFrame {
+                _openni::VideoFrameRef frameRef;
+                //! host time readFrame() returned
+                uint64_t readTime;
+            };
+
+            //! A stream's published frame, the source of the derived nodes.
+            class FrameData : public FrameDataAbstract {
+            public:
+                FrameData( _openni::VideoStream &stream, Vec2i size );
+
+                _openni::VideoStream &stream;
+                //! cached, querying it goes through the driver
+                int maxPixelValue;
+                //! the frame currently published to getters
+                _openni::VideoFrameRef frameRef;
+                uint64_t frameReadTime;
+                //! written by whichever thread reads the stream
+                TripleBuffer< CapturedFrame > frameBuffer;
+                //! most recently consumed frames, for timestamp matching
+                enum { HISTORY_SIZE = 4 };
+                CapturedFrame history[HISTORY_SIZE];
+                int historyNext;
+
+                //! written by the reading thread only
+                std::atomic< uint64_t > framesRead, framesDropped, framesSkipped;
+                //! written by the updating thread only
+                std::atomic< uint64_t > framesConsumed;
+                int lastFrameIndex;
+                //! host time of the last frame read, for the watchdog
+                std::atomic< uint64_t > lastReadTime;
+                bool isStalled;
+                uint64_t stalls;
+                int64_t shortestDelay;
+                RollingSamples deviceToRead, readDuration, readToPublish, readToTexture;
+                void getStats( StreamStats &stats ) const;
+                //! zero-copy views of frameRef, only the one matching the
+                //! stream's pixel type is used
+                Channel16u channel;
+                Surface8u surface;
+                //! generation the views were made from
+                uint64_t viewGeneration;
+
+                template < typename image_t >
+                void updateImage();
+            };
+
+            //! Depth scaled to 8 bit for display.
+            class DerivedFrameData : public FrameDataAbstract {
+            public:
+                DerivedFrameData();
+                ~DerivedFrameData();
+
+                //! Makes \a _original the input of this node.
+                void setOriginal( FrameData &_original );
+                DepthVisualizer visualizer;
+                //! Goes stale if the visualizer settings changed since the
+                //! last conversion.
+                void checkVisualizer();
+                //! Converts the original frame, computes the node.
+                bool updateData();
+                template < typename image_t >
+                void updateImage();
+
+                FrameData *original;
+                //! 8 bit gray, or RGB with a colormap
+                uint8_t *convertedData;
+            private:
+                //! bytes allocated at convertedData, a re-setup may need more
+                size_t convertedCapacity;
+                void convertData( const _openni::DepthPixel *originalData, uint8_t **convertedData );
+                template < typename image_t, typename pixel_t >
+                ImageSourceRef updateDataImage( pixel_t *data );
+                //! depth scale of the original stream, see getDepthScale()
+                uint32_t scale;
+                uint32_t visualizerVersion;
+            };
+
+            //! Raw depth run through one of the depth filters.
+            template < typename filter_t >
+            class FilteredFrameData : public FrameDataAbstract {
+            public:
+                FilteredFrameData() : FrameDataAbstract( Vec2i::zero() ) {}
+
+                filter_t filter;
+                //! wraps the filter's output
+                Channel16u channel;
+            };
+
+            typedef std::shared_ptr< FrameData > FrameDataRef;
+
+            std::vector< FrameDataRef > all;
+            std::vector< _openni::VideoStream * > allStreams;
+            DerivedFrameData scaledDepthFrameData;
+
+            FilteredFrameData< TemporalDepthFilter > temporalDepthFrameData;
+            FilteredFrameData< SpatialDepthFilter > cleanDepthFrameData;
+
+            FrameData & getFrameData( int index );
+            //! Converted depth for getDepthImage() and Camera::getDepthTex().
+            DerivedFrameData & updateScaledDepth();
+            //! Filtered depth for getFilteredDepthImage() and
+            //! Camera::getFilteredDepthTex().
+            FilteredFrameData< TemporalDepthFilter > & updateFilteredDepth();
+            //! Filtered depth for getCleanDepthImage() and
+            //! Camera::getCleanDepthTex().
+            FilteredFrameData< SpatialDepthFilter > & updateCleanDepth();
+
+            static std::ostream *logStream;
+
+            RollingSamples depthConversionSamples, temporalFilterSamples, spatialFilterSamples, pointCloudSamples, registrationSamples,
+                           textureUploadSamples;
+
+        private:
+            //! Wires the derived nodes to the streams opened by setup().
+            void setupDerivedNodes();
+            //! Detaches the derived nodes from the streams, which close()
+            //! destroys.
+            void clearDerivedNodes();
+
+            PointCloudGenerator pointCloudGenerator;
+            std::vector< Vec3f > pointCloud, normals;
+            PointCloudSoA pointCloudSoA;
+            DerivedNode pointCloudNode, pointCloudSoANode, normalsNode;
+            int pointCloudSource;
+            std::shared_ptr< RowExecutor > executor;
+            DerivedNode & getPointCloudInput();
+            void setupPointCloudGenerator( FrameData &frame );
+            //! The depth behind pointCloudSource, stride in bytes.
+            const uint16_t * getPointCloudDepth( int &strideInBytes );
+            bool computePointCloud();
+            bool computePointCloudSoA();
+            bool computeNormals();
+
+            DepthRegistration registration;
+            bool hasCustomRegistration;
+            Channel16u registeredDepth;
+            DerivedNode registeredDepthNode;
+            void setupRegistration( FrameData &depth, FrameData &color );
+            bool computeRegisteredDepth();
+
+            template < typename filter_t >
+            bool filterDepth( FilteredFrameData< filter_t > &frame, RollingSamples &samples );
+            template < typename filter_t >
+            ImageSourceRef getFilteredImage( FilteredFrameData< filter_t > &frame );
+
+            bool syncEnabled;
+            uint64_t syncTolerance;
+            bool publishSyncedFrames();
+
+            int stallTimeout, stallAction;
+            StallCallback stallCallback;
+            void checkStalls();
+            void restartStream( int streamIndex );
+
+            int captureMode;
+            std::thread captureThread;
+            std::atomic< bool > isCapturing;
+
+            class StreamListener : public _openni::VideoStream::NewFrameListener {
+            public:
+                StreamListener( CameraCore &camera, int streamIndex );
+                void onNewFrame( _openni::VideoStream &stream );
+
+                CameraCore &camera;
+                int streamIndex;
+            };
+            std::vector< std::shared_ptr< StreamListener > > listeners;
+
+            struct FrameCallbackData {
+                CallbackId id;
+                //! by sensor rather than stream index, which may change when
+                //! the camera is set up again
+                _openni::SensorType sensorType;
+                int dispatchMode;
+                //! shared with queued jobs, so posting one never copies the
+                //! callback
+                std::shared_ptr< FrameCallbackSlot > callback;
+            };
+            //! replaced, never modified, when callbacks are added or removed,
+            //! so dispatching can call them without holding callbacksMutex
+            std::shared_ptr< const std::vector< FrameCallbackData > > frameCallbacks;
+            //! 0 is never handed out
+            CallbackId nextCallbackId;
+            std::mutex callbacksMutex;
+            FrameDispatcher dispatcher;
+
+            CallbackId addFrameCallback( _openni::SensorType sensorType, FrameCallback callback, int dispatchMode );
+            void dispatchFrame( const _openni::VideoFrameRef &frameRef );
+
+            void setupDevice( const char *uri, int enableSensors, int captureMode );
+            int setupStream( _openni::VideoStream &stream, _openni::SensorType sensorType );
+            void updateStream( int streamIndex );
+            void readStream( int streamIndex );
+            bool publishStream( int streamIndex );
+            void invalidateStream( int streamIndex );
+            void startCapture();
+            void stopCapture();
+            void captureLoop();
+        };
+
+        typedef std::shared_ptr< CameraCore > CameraCoreRef;
+    }
+}
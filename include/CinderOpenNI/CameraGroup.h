@@ -0,0 +1,31 @@
+#pragma once
+
+#include "CinderOpenNI/Camera.h"
+
+namespace cinder {
+    namespace openni {
+        //! Runs several devices from one process. Every camera captures on
+        //! its own thread into its own frame buffers, so a slow or stalled
+        //! device never holds up the others.
+        class CameraGroup {
+        public:
+            //! Opens every device enumerateDevices() reports.
+            void setup( int enableSensors=Camera::SENSOR_DEPTH|Camera::SENSOR_COLOR, int captureMode=Camera::CAPTURE_THREADED );
+            //! Opens the given device URIs or .oni files, in order, closing
+            //! any opened before. If one fails to open, the others are
+            //! closed again and its CameraException is rethrown.
+            void setup( const std::vector< std::string > &uris, int enableSensors=Camera::SENSOR_DEPTH|Camera::SENSOR_COLOR,
+                        int captureMode=Camera::CAPTURE_THREADED );
+            //! Publishes the latest frames of every camera.
+            void update();
+            void close();
+
+            size_t size() const { return cameras.size(); }
+            Camera & operator[]( size_t index ) { return *cameras.at( index ); }
+            const std::vector< CameraRef > & getCameras() const { return cameras; }
+
+        private:
+            std::vector< CameraRef > cameras;
+        };
+    }
+}
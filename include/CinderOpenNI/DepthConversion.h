@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cinder {
+    namespace openni {
+        enum SIMD_LEVELS {
+            SIMD_NONE,
+            SIMD_SSE2,
+            SIMD_AVX2
+        };
+
+        //! Best instruction set supported by both the build and the CPU we
+        //! are running on. Detected once.
+        int getSimdLevel();
+
+        //! 16.16 fixed point factor mapping [0, maxValue] onto [0, 255].
+        //! Exceeds 16 bits for maxValue < 255.
+        uint32_t getDepthScale( int maxValue );
+
+        //! dst[i] = min( src[i] * scale >> 16, 255 ), using the fastest kernel
+        //! available at runtime.
+        void convertDepthTo8u( const uint16_t *src, uint8_t *dst, size_t count, uint32_t scale );
+
+        //! The individual kernels, exposed for benchmarking. The SIMD ones
+        //! must only be called if getSimdLevel() reports support.
+        void convertDepthTo8uScalar( const uint16_t *src, uint8_t *dst, size_t count, uint32_t scale );
+        void convertDepthTo8uSse2( const uint16_t *src, uint8_t *dst, size_t count, uint32_t scale );
+        void convertDepthTo8uAvx2( const uint16_t *src, uint8_t *dst, size_t count, uint32_t scale );
+    }
+}
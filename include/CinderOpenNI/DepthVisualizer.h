@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cinder {
+    namespace openni {
+        //! Maps raw depth to displayable 8-bit gray or RGB through a 64K entry
+        //! lookup table, so each pixel costs a single table read. The table is
+        //! only rebuilt when a setting changes, except for COLORMAP_HISTOGRAM
+        //! which equalizes every frame.
+        class DepthVisualizer {
+        public:
+            enum COLORMAPS {
+                COLORMAP_GRAYSCALE,
+                COLORMAP_TURBO,
+                COLORMAP_JET,
+                //! NiViewer-style cumulative histogram, near is bright
+                COLORMAP_HISTOGRAM
+            };
+
+            DepthVisualizer();
+
+            //! Depth window in raw units. Depths outside of it (and invalid
+            //! zero depths) map to black. A far of 0 uses the stream's
+            //! maximum value.
+            void setRange( uint16_t nearDepth, uint16_t farDepth );
+            void setGamma( float gamma );
+            void setColormap( int colormap );
+            //! Largest value the depth stream reports, set by the camera.
+            void setMaxValue( uint16_t maxValue );
+
+            uint16_t getNear() const { return nearValue; }
+            uint16_t getFar() const { return farValue == 0 ? maxValue : farValue; }
+            float getGamma() const { return gamma; }
+            int getColormap() const { return colormap; }
+            //! Bumped by every setting change.
+            uint32_t getVersion() const { return version; }
+
+            //! Output bytes per pixel: 1 for gray colormaps, 3 for RGB.
+            int getChannels() const;
+            //! True when the settings amount to the plain 0..max linear
+            //! grayscale ramp, which has a faster SIMD path.
+            bool isLinear() const;
+
+            //! Writes getChannels() bytes per pixel to \a dst.
+            void apply( const uint16_t *src, uint8_t *dst, size_t count );
+
+        private:
+            void buildTable();
+            void buildHistogramTable( const uint16_t *src, size_t count );
+            void writeEntry( uint16_t depth, float t );
+
+            uint16_t nearValue, farValue, maxValue;
+            float gamma;
+            int colormap;
+            uint32_t version;
+
+            std::vector< uint8_t > table;
+            std::vector< uint32_t > histogram;
+            bool isTableDirty;
+        };
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace cinder {
+    namespace openni {
+        //! One product in the graph of data derived from camera frames, such
+        //! as scaled depth, filtered depth or a point cloud. A node lists the
+        //! nodes it is computed from; touching a source node (a new frame
+        //! arrived) marks everything downstream of it stale, and stale nodes
+        //! are only recomputed when something asks for them through update().
+        //!
+        //! Nodes point at each other, so they must outlive their edges and
+        //! can't be copied.
+        class DerivedNode {
+        public:
+            //! Fills in the node's data from its (fresh) inputs. Returns
+            //! false if there is nothing to compute from yet.
+            typedef std::function< bool () > ComputeFn;
+
+            //! A source node without \a compute only becomes fresh through
+            //! touch().
+            DerivedNode( const ComputeFn &compute = ComputeFn() );
+            ~DerivedNode();
+
+            void setCompute( const ComputeFn &_compute ){ compute = _compute; }
+            //! \a input has to be up to date before this node is computed,
+            //! and invalidates it when it changes.
+            void addInput( DerivedNode &input );
+            void clearInputs();
+
+            //! Marks this node and every node derived from it stale.
+            void invalidate();
+            //! New data for a source node: bumps its generation and
+            //! invalidates what is derived from it.
+            void touch();
+            //! Brings the inputs and then this node up to date, if stale.
+            //! Returns whether the node holds fresh data.
+            bool update();
+
+            bool isFresh() const { return fresh; }
+            //! Bumped whenever the node's data changes, so layers on top
+            //! (images, textures) know when to refresh.
+            uint64_t getGeneration() const { return generation; }
+
+        private:
+            DerivedNode( const DerivedNode & );
+            DerivedNode & operator=( const DerivedNode & );
+
+            void removeDependent( DerivedNode *dependent );
+
+            ComputeFn compute;
+            std::vector< DerivedNode * > inputs, dependents;
+            bool fresh;
+            uint64_t generation;
+        };
+    }
+}
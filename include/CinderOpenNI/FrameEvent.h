@@ -0,0 +1,92 @@
+#pragma once
+
+#include "cinder/Function.h"
+#include "cinder/Thread.h"
+#include "cinder/Vector.h"
+#include "OpenNI.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace cinder {
+    namespace openni {
+        namespace _openni = ::openni;
+
+        //! Read-only view of a frame handed to frame callbacks. Holds a
+        //! reference to the underlying frame, so it may be copied and kept
+        //! past the callback.
+        class FrameEvent {
+        public:
+            FrameEvent() {}
+            FrameEvent( const _openni::VideoFrameRef &frameRef ) : frameRef( frameRef ) {}
+
+            const _openni::VideoFrameRef & getFrameRef() const { return frameRef; }
+            const void * getData() const { return frameRef.getData(); }
+            int getStrideInBytes() const { return frameRef.getStrideInBytes(); }
+            Vec2i getSize() const { return Vec2i( frameRef.getWidth(), frameRef.getHeight() ); }
+            //! Device timestamp in microseconds.
+            uint64_t getTimestamp() const { return frameRef.getTimestamp(); }
+            int getFrameIndex() const { return frameRef.getFrameIndex(); }
+
+        private:
+            _openni::VideoFrameRef frameRef;
+        };
+
+        typedef std::function< void ( const FrameEvent & ) > FrameCallback;
+
+        //! A registered frame callback. Removing it waits for a call in
+        //! progress on another thread, so once remove() returns the callback
+        //! isn't running and never runs again, even from queued jobs. A
+        //! callback may remove itself.
+        class FrameCallbackSlot {
+        public:
+            FrameCallbackSlot( const FrameCallback &callback ) : callback( callback ), isRemoved( false ) {}
+
+            void call( const FrameEvent &event )
+            {
+                std::lock_guard< std::recursive_mutex > lock( mutex );
+                if ( !isRemoved ) callback( event );
+            }
+            void remove()
+            {
+                std::lock_guard< std::recursive_mutex > lock( mutex );
+                isRemoved = true;
+            }
+
+        private:
+            FrameCallback callback;
+            //! held while the callback runs, recursive for self-removal
+            std::recursive_mutex mutex;
+            bool isRemoved;
+        };
+
+        //! Runs frame callbacks on a single worker thread. When the worker
+        //! falls behind, the oldest pending frame is dropped instead of
+        //! letting the queue grow. Posting doesn't allocate.
+        class FrameDispatcher {
+        public:
+            FrameDispatcher( size_t capacity = 4 );
+            ~FrameDispatcher();
+
+            void start();
+            void stop();
+            void post( const std::shared_ptr< FrameCallbackSlot > &callback, const FrameEvent &event );
+
+        private:
+            struct Job {
+                std::shared_ptr< FrameCallbackSlot > callback;
+                FrameEvent event;
+            };
+
+            void run();
+
+            std::vector< Job > jobs;
+            size_t first, count;
+            std::mutex mutex;
+            std::condition_variable condition;
+            std::thread thread;
+            bool isRunning;
+        };
+    }
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include "cinder/ImageIo.h"
+#include "OpenNI.h"
+
+namespace cinder {
+    namespace openni {
+        namespace _openni = ::openni;
+
+        class ImageSourceColor : public ci::ImageSource
+        {
+        public:
+            ImageSourceColor( _openni::RGB888Pixel *buffer, int width, int height )
+            : ci::ImageSource(), _width(width), _height(height), mData( buffer )
+            {
+                init();
+            }
+
+            //! Keeps \a frame referenced for as long as the image source
+            //! lives, so its pixels can't be recycled under a reader.
+            ImageSourceColor( const _openni::VideoFrameRef &frame )
+            : ci::ImageSource(), mFrameRef( frame ), _width( frame.getWidth() ), _height( frame.getHeight() ),
+            mData( (_openni::RGB888Pixel *)frame.getData() )
+            {
+                init();
+            }
+
+            //! Points an existing image source at other pixels, so it can be
+            //! reused instead of allocating a new one per frame.
+            void setData( _openni::RGB888Pixel *buffer, int width, int height )
+            {
+                mFrameRef.release();
+                mData = buffer;
+                _width = width;
+                _height = height;
+                init();
+            }
+
+            void setFrame( const _openni::VideoFrameRef &frame )
+            {
+                mFrameRef = frame;
+                mData = (_openni::RGB888Pixel *)frame.getData();
+                _width = frame.getWidth();
+                _height = frame.getHeight();
+                init();
+            }
+
+            ~ImageSourceColor()
+            {
+            }
+
+            virtual void load( ci::ImageTargetRef target )
+            {
+                ImageSource::RowFunc func = setupRowFunc( target );
+
+                for( uint32_t row	 = 0; row < _height; ++row )
+                    ((*this).*func)( target, row, mData + row * _width );
+            }
+
+        protected:
+            void init()
+            {
+                setSize( _width, _height );
+                setColorModel( ImageIo::CM_RGB );
+                setChannelOrder( ImageIo::RGB );
+                setDataType( ImageIo::UINT8 );
+            }
+
+            _openni::VideoFrameRef		mFrameRef;
+            uint32_t					_width, _height;
+            _openni::RGB888Pixel		*mData;
+        };
+
+
+        class ImageSourceRawDepth : public ci::ImageSource
+        {
+        public:
+            ImageSourceRawDepth( _openni::DepthPixel *buffer, int width, int height )
+            : ci::ImageSource(), _width(width), _height(height), mData( buffer )
+            {
+                init();
+            }
+
+            //! Keeps \a frame referenced for as long as the image source
+            //! lives, so its pixels can't be recycled under a reader.
+            ImageSourceRawDepth( const _openni::VideoFrameRef &frame )
+            : ci::ImageSource(), mFrameRef( frame ), _width( frame.getWidth() ), _height( frame.getHeight() ),
+            mData( (_openni::DepthPixel *)frame.getData() )
+            {
+                init();
+            }
+
+            void setData( _openni::DepthPixel *buffer, int width, int height )
+            {
+                mFrameRef.release();
+                mData = buffer;
+                _width = width;
+                _height = height;
+                init();
+            }
+
+            void setFrame( const _openni::VideoFrameRef &frame )
+            {
+                mFrameRef = frame;
+                mData = (_openni::DepthPixel *)frame.getData();
+                _width = frame.getWidth();
+                _height = frame.getHeight();
+                init();
+            }
+
+            ~ImageSourceRawDepth()
+            {
+            }
+
+            virtual void load( ci::ImageTargetRef target )
+            {
+                ci::ImageSource::RowFunc func = setupRowFunc( target );
+
+                for( uint32_t row = 0; row < _height; ++row )
+                    ((*this).*func)( target, row, mData + row * _width );
+            }
+            
+        protected:
+            void init()
+            {
+                setSize( _width, _height );
+                setColorModel( ci::ImageIo::CM_GRAY );
+                setChannelOrder( ci::ImageIo::Y );
+                setDataType( ci::ImageIo::UINT16 );
+            }
+
+            _openni::VideoFrameRef		mFrameRef;
+            uint32_t					_width, _height;
+            _openni::DepthPixel			*mData;
+        };
+
+        class ImageSourceDepth : public ci::ImageSource
+        {
+        public:
+            ImageSourceDepth( uint8_t *buffer, int width, int height )
+            : ci::ImageSource(), _width(width), _height(height), mData( buffer )
+            {
+                init();
+            }
+
+            void setData( uint8_t *buffer, int width, int height )
+            {
+                mData = buffer;
+                _width = width;
+                _height = height;
+                init();
+            }
+
+            ~ImageSourceDepth()
+            {
+            }
+
+            virtual void load( ci::ImageTargetRef target )
+            {
+                ci::ImageSource::RowFunc func = setupRowFunc( target );
+
+                for( uint32_t row = 0; row < _height; ++row )
+                    ((*this).*func)( target, row, mData + row * _width );
+            }
+
+        protected:
+            void init()
+            {
+                setSize( _width, _height );
+                setColorModel( ci::ImageIo::CM_GRAY );
+                setChannelOrder( ci::ImageIo::Y );
+                setDataType( ci::ImageIo::UINT8 );
+            }
+
+            uint32_t					_width, _height;
+            uint8_t                     *mData;
+        };
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cinder {
+    namespace openni {
+        //! Small persistent thread pool for splitting per-row image work.
+        //! Workers sleep between jobs, so running a job costs a wake-up
+        //! rather than a thread creation.
+        class RowExecutor {
+        public:
+            typedef std::function< void ( int beginRow, int endRow ) > RowTask;
+
+            //! \a threadCount includes the calling thread. 0 uses one thread
+            //! per hardware core, 1 runs everything on the caller.
+            explicit RowExecutor( size_t threadCount = 0 );
+            ~RowExecutor();
+
+            size_t getThreadCount() const { return workers.size() + 1; }
+
+            //! Runs \a task over [0, rows) in tiles of \a tileRows rows and
+            //! returns once every tile is done. The caller works too.
+            void run( int rows, const RowTask &task, int tileRows = 16 );
+
+        private:
+            RowExecutor( const RowExecutor & );
+            RowExecutor & operator=( const RowExecutor & );
+
+            void workerLoop();
+            void runTiles();
+
+            std::vector< std::thread > workers;
+            std::mutex mutex;
+            std::condition_variable startCondition, doneCondition;
+            uint64_t generation;
+            size_t busyWorkers;
+            bool isStopping;
+
+            const RowTask *task;
+            int rows, tileRows;
+            std::atomic< int > nextRow;
+        };
+    }
+}
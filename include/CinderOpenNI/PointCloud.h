@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cinder {
+    namespace openni {
+        class RowExecutor;
+
+        //! Turns depth frames into world space points with the same pinhole
+        //! model as CoordinateConverter::convertDepthToWorld, but from
+        //! precomputed ray tables so each point costs three multiplies.
+        //! The model is separable, so one table per axis is enough.
+        class PointCloudGenerator {
+        public:
+            PointCloudGenerator();
+
+            //! Rebuilds the ray tables. Fields of view are in radians; depth
+            //! values are multiplied by \a millimetersPerUnit so points come
+            //! out in millimeters.
+            void setup( int width, int height, float horizontalFov, float verticalFov, float millimetersPerUnit );
+            bool isSetup( int _width, int _height ) const { return width == _width && height == _height; }
+
+            int getWidth() const { return width; }
+            int getHeight() const { return height; }
+
+            //! Writes width * height interleaved x, y, z triplets to \a xyz
+            //! (the layout of a Vec3f array). Invalid depth gives 0, 0, 0.
+            void convert( const uint16_t *depth, int strideInBytes, float *xyz, RowExecutor *executor = NULL ) const;
+            //! Same as convert() with one array per coordinate.
+            void convert( const uint16_t *depth, int strideInBytes, float *x, float *y, float *z, RowExecutor *executor = NULL ) const;
+
+            //! Single row kernels, exposed for benchmarking.
+            void convertRowScalar( const uint16_t *depth, int row, float *xyz ) const;
+            void convertRow( const uint16_t *depth, int row, float *xyz ) const;
+            void convertRowScalar( const uint16_t *depth, int row, float *x, float *y, float *z ) const;
+            void convertRow( const uint16_t *depth, int row, float *x, float *y, float *z ) const;
+
+            //! Unit surface normals of a width * height interleaved point
+            //! cloud, from the points' left/right and top/bottom neighbors,
+            //! facing the camera. Points at the border, without depth or
+            //! next to one without depth get 0, 0, 0.
+            static void computeNormals( const float *xyz, int width, int height, float *normals, RowExecutor *executor = NULL );
+
+        private:
+            int width, height;
+            float millimetersPerUnit;
+            //! x / z per column and y / z per row
+            std::vector< float > raysX, raysY;
+        };
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#if defined( CINDER_OPENNI_FREENECT )
+#   include "libfreenect/libfreenect-registration.h"
+#endif
+
+namespace cinder {
+    namespace openni {
+        //! Warps depth frames into the color camera's view in software, for
+        //! drivers without IMAGE_REGISTRATION_DEPTH_TO_COLOR. Like
+        //! libfreenect, the mapping is split into a per-pixel table (where a
+        //! pixel lands at a reference depth) and a per-depth table (how far
+        //! it slides along the baseline at other depths), both built once
+        //! per video mode. How far pixels slide also varies across the
+        //! image, a per-pixel factor scales the per-depth table for that.
+        class DepthRegistration {
+        public:
+            typedef std::function< bool ( int depthX, int depthY, uint16_t depthZ, int *colorX, int *colorY ) > DepthToColor;
+
+            DepthRegistration();
+
+            //! Builds the tables by sampling \a depthToColor, usually
+            //! CoordinateConverter::convertDepthToColor: per pixel at
+            //! \a referenceDepth, a quarter and four times of it, and once
+            //! per depth value at the center pixel. Pixels land within a few
+            //! pixels of where \a depthToColor maps them, exactly where the
+            //! shift is the same across the image. Returns false if
+            //! \a depthToColor fails.
+            bool setup( int depthWidth, int depthHeight, int colorWidth, int colorHeight, uint16_t maxDepth,
+                        const DepthToColor &depthToColor, uint16_t referenceDepth=2000 );
+            //! Plain rescaling from depth to color resolution, for drivers
+            //! that can't map coordinates at all.
+            void setupUnregistered( int depthWidth, int depthHeight, int colorWidth, int colorHeight, uint16_t maxDepth );
+#if defined( CINDER_OPENNI_FREENECT )
+            //! Uses the tables libfreenect reads from a Kinect, for 640x480
+            //! depth in millimeters. Nothing detects the driver, pass the
+            //! result to CameraCore::setDepthRegistration().
+            void setup( const freenect_registration &registration );
+#endif
+
+            bool isSetup( int _depthWidth, int _depthHeight, int _colorWidth, int _colorHeight ) const
+            {
+                return depthWidth == _depthWidth && depthHeight == _depthHeight && colorWidth == _colorWidth && colorHeight == _colorHeight;
+            }
+            int getDepthWidth() const { return depthWidth; }
+            int getDepthHeight() const { return depthHeight; }
+            int getColorWidth() const { return colorWidth; }
+            int getColorHeight() const { return colorHeight; }
+
+            //! Where apply() puts depth pixel (\a depthX, \a depthY) at
+            //! \a depthZ, as a DepthToColor. The position may lie outside the
+            //! color image. Returns false outside the depth image or range.
+            bool map( int depthX, int depthY, uint16_t depthZ, int *colorX, int *colorY ) const;
+
+            //! Writes colorWidth * colorHeight depth values to \a registered
+            //! in a single pass. When color has the higher resolution, each
+            //! depth pixel covers the block of color pixels it scales to,
+            //! so the result has no holes. Where several depth pixels land
+            //! on the same color pixel, the nearest one wins.
+            void apply( const uint16_t *depth, int strideInBytes, uint16_t *registered ) const;
+
+        private:
+            void allocate( int depthWidth, int depthHeight, int colorWidth, int colorHeight, uint16_t maxDepth );
+
+            int depthWidth, depthHeight, colorWidth, colorHeight;
+            //! color x in 24.8 fixed point and color row, per depth pixel
+            std::vector< int32_t > baseX, baseY;
+            //! color x offset in 24.8 fixed point, per depth value, at the
+            //! center pixel
+            std::vector< int32_t > shiftX;
+            //! shiftX scale per depth pixel, in 8.8 fixed point
+            std::vector< int32_t > shiftScale;
+            //! subtracted from every color pixel index (libfreenect padding)
+            int32_t indexOffset;
+            //! color pixels each depth pixel is written to
+            int splatWidth, splatHeight;
+        };
+    }
+}
@@ -0,0 +1,330 @@
+#pragma once
+
+// Layout of the shared memory frame rings written by SharedFramePublisher
+// and read by SharedCamera and the SharedMemory OpenNI driver. Only depends
+// on the standard library and POSIX, so processes that don't link Cinder or
+// the block (drivers, recorders) can include it as is.
+
+#if !defined( _WIN32 )
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <cerrno>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cinder {
+    namespace openni {
+        enum {
+            SHARED_RING_MAGIC = 0x52494E4F, // "ONIR"
+            SHARED_RING_VERSION = 2,
+            //! headers and slot data start on cache line boundaries
+            SHARED_RING_ALIGNMENT = 64
+        };
+
+        //! Start of the shared memory object. Everything but the atomics is
+        //! written once, before magic is set.
+        struct SharedRingHeader {
+            //! SHARED_RING_MAGIC once the ring is initialized
+            std::atomic< uint32_t > magic;
+            uint32_t version;
+            uint32_t slotCount;
+            //! bytes from one slot header to the next
+            uint32_t slotStride;
+            //! room for pixels in each slot
+            uint32_t slotDataSize;
+            //! OniSensorType and OniPixelFormat values
+            int32_t sensorType, pixelFormat;
+            //! video mode the ring was created for, frames may be smaller
+            int32_t width, height, fps;
+            int32_t maxValue;
+            //! radians
+            float horizontalFov, verticalFov;
+            //! process id of the publisher
+            int32_t ownerPid;
+            //! set by the publisher before it removes the ring, readers
+            //! should reopen it by name
+            std::atomic< uint32_t > isClosed;
+            //! frames published so far; frame n is in slot n % slotCount
+            std::atomic< uint64_t > published;
+        };
+
+        //! Precedes every slot's pixels. The sequence is a seqlock: odd while
+        //! the publisher writes the slot, and different once it has been
+        //! rewritten.
+        struct SharedSlotHeader {
+            std::atomic< uint64_t > sequence;
+            //! position in the publishing order
+            uint64_t frameNumber;
+            //! device timestamp in microseconds, and the driver's frame index
+            uint64_t timestamp;
+            int32_t frameIndex;
+            int32_t width, height, strideInBytes;
+        };
+
+        //! A frame as read from a ring, pointing into the shared memory.
+        struct SharedFrameView {
+            SharedFrameView() : data( NULL ), width( 0 ), height( 0 ), strideInBytes( 0 ), timestamp( 0 ), frameIndex( 0 ),
+                                frameNumber( 0 ), sequence( 0 ), slot( NULL ) {}
+
+            const uint8_t *data;
+            int width, height, strideInBytes;
+            uint64_t timestamp;
+            int frameIndex;
+            uint64_t frameNumber;
+            //! the slot's sequence when it was read, see SharedFrameRing::isIntact()
+            uint64_t sequence;
+            const SharedSlotHeader *slot;
+        };
+
+        //! Formats a ring is created with.
+        struct SharedRingFormat {
+            int32_t sensorType, pixelFormat, width, height, fps, maxValue;
+            float horizontalFov, verticalFov;
+        };
+
+        //! One POSIX shared memory object holding a ring of frames of one
+        //! stream. A single process creates and writes it; any number of
+        //! others map it read-only and pick up frames without copying or
+        //! any system call, so they can't slow down the writer or each
+        //! other. Readers of a slot get slotCount - 1 frame periods before
+        //! the writer comes around to it again.
+        class SharedFrameRing {
+        public:
+            SharedFrameRing() : header( NULL ), mappedSize( 0 ), isOwner( false ) {}
+            ~SharedFrameRing() { close(); }
+
+            //! Creates the ring \a name (e.g. "/cinder-openni-kinect-depth").
+            //! Fails while another publisher owns that name, but replaces a
+            //! ring left behind by one that crashed.
+            bool create( const std::string &_name, const SharedRingFormat &format, uint32_t slotCount, uint32_t slotDataSize )
+            {
+                close();
+                int fd = shm_open( _name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600 );
+                if ( fd < 0 && errno == EEXIST && !isOwnerAlive( _name ) ) {
+                    shm_unlink( _name.c_str() );
+                    fd = shm_open( _name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600 );
+                }
+                if ( fd < 0 ) return false;
+
+                uint32_t slotStride = (uint32_t)( align( sizeof( SharedSlotHeader ) ) + align( slotDataSize ) );
+                size_t size = align( sizeof( SharedRingHeader ) ) + (size_t)slotStride * slotCount;
+                void *memory = ftruncate( fd, size ) == 0 ? mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 ) : MAP_FAILED;
+                ::close( fd );
+                if ( memory == MAP_FAILED ) {
+                    shm_unlink( _name.c_str() );
+                    return false;
+                }
+
+                header = new ( memory ) SharedRingHeader();
+                header->version = SHARED_RING_VERSION;
+                header->slotCount = slotCount;
+                header->slotStride = slotStride;
+                header->slotDataSize = slotDataSize;
+                header->sensorType = format.sensorType;
+                header->pixelFormat = format.pixelFormat;
+                header->width = format.width;
+                header->height = format.height;
+                header->fps = format.fps;
+                header->maxValue = format.maxValue;
+                header->horizontalFov = format.horizontalFov;
+                header->verticalFov = format.verticalFov;
+                header->ownerPid = (int32_t)getpid();
+                header->isClosed.store( 0, std::memory_order_relaxed );
+                header->published.store( 0, std::memory_order_relaxed );
+                for ( uint32_t i = 0; i < slotCount; ++i ) {
+                    SharedSlotHeader *slot = new ( getSlot( i ) ) SharedSlotHeader();
+                    slot->sequence.store( 0, std::memory_order_relaxed );
+                }
+                header->magic.store( SHARED_RING_MAGIC, std::memory_order_release );
+
+                name = _name;
+                mappedSize = size;
+                isOwner = true;
+                return true;
+            }
+
+            //! Maps an existing ring read-only. Fails if there is none (yet).
+            bool open( const std::string &_name )
+            {
+                close();
+                int fd = shm_open( _name.c_str(), O_RDONLY, 0 );
+                if ( fd < 0 ) return false;
+
+                struct stat info;
+                void *memory = MAP_FAILED;
+                if ( fstat( fd, &info ) == 0 && (size_t)info.st_size >= sizeof( SharedRingHeader ) ) {
+                    memory = mmap( NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+                }
+                ::close( fd );
+                if ( memory == MAP_FAILED ) return false;
+
+                header = (SharedRingHeader *)memory;
+                mappedSize = info.st_size;
+                // the publisher may still be setting it up
+                bool isValid = header->magic.load( std::memory_order_acquire ) == SHARED_RING_MAGIC
+                               && header->version == SHARED_RING_VERSION
+                               && align( sizeof( SharedRingHeader ) ) + (size_t)header->slotStride * header->slotCount <= mappedSize;
+                if ( !isValid ) {
+                    close();
+                    return false;
+                }
+                name = _name;
+                return true;
+            }
+
+            //! The owner marks the ring closed and removes its name; mappings
+            //! stay readable until they are closed too.
+            void close()
+            {
+                if ( header == NULL ) return;
+
+                if ( isOwner ) {
+                    header->isClosed.store( 1, std::memory_order_release );
+                    shm_unlink( name.c_str() );
+                }
+                munmap( (void *)header, mappedSize );
+                header = NULL;
+                mappedSize = 0;
+                isOwner = false;
+            }
+
+            bool isOpen() const { return header != NULL; }
+            //! The publisher went away, or replaced the ring with a new one.
+            bool isClosed() const { return header->isClosed.load( std::memory_order_acquire ) != 0; }
+            const SharedRingHeader & getHeader() const { return *header; }
+
+            //! Copies a frame into the next slot. Only the creating process
+            //! may write. Returns false if the frame doesn't fit.
+            bool write( const void *data, int strideInBytes, int width, int height, int bytesPerPixel, uint64_t timestamp, int frameIndex )
+            {
+                size_t rowBytes = (size_t)width * bytesPerPixel;
+                if ( rowBytes * height > header->slotDataSize ) return false;
+
+                uint64_t frameNumber = header->published.load( std::memory_order_relaxed );
+                SharedSlotHeader *slot = getSlot( frameNumber % header->slotCount );
+                uint64_t sequence = slot->sequence.load( std::memory_order_relaxed );
+                slot->sequence.store( sequence + 1, std::memory_order_relaxed );
+                std::atomic_thread_fence( std::memory_order_release );
+
+                slot->frameNumber = frameNumber;
+                slot->timestamp = timestamp;
+                slot->frameIndex = frameIndex;
+                slot->width = width;
+                slot->height = height;
+                slot->strideInBytes = (int32_t)rowBytes;
+                uint8_t *slotData = (uint8_t *)slot + align( sizeof( SharedSlotHeader ) );
+                if ( strideInBytes == (int)rowBytes ) {
+                    std::memcpy( slotData, data, rowBytes * height );
+                }
+                else {
+                    for ( int y = 0; y < height; ++y ) {
+                        std::memcpy( slotData + y * rowBytes, (const uint8_t *)data + y * strideInBytes, rowBytes );
+                    }
+                }
+
+                slot->sequence.store( sequence + 2, std::memory_order_release );
+                header->published.store( frameNumber + 1, std::memory_order_release );
+                return true;
+            }
+
+            //! Points \a view at the newest complete frame, without copying.
+            //! Returns false if nothing was published yet.
+            bool readLatest( SharedFrameView &view ) const
+            {
+                // the newest slot is only being rewritten if the writer lapped
+                // the whole ring since, so a few retries always succeed
+                for ( int attempt = 0; attempt < 4; ++attempt ) {
+                    uint64_t published = header->published.load( std::memory_order_acquire );
+                    if ( published == 0 ) return false;
+
+                    const SharedSlotHeader *slot = getSlot( ( published - 1 ) % header->slotCount );
+                    uint64_t sequence = slot->sequence.load( std::memory_order_acquire );
+                    if ( sequence & 1 ) continue;
+
+                    view.frameNumber = slot->frameNumber;
+                    view.timestamp = slot->timestamp;
+                    view.frameIndex = slot->frameIndex;
+                    view.width = slot->width;
+                    view.height = slot->height;
+                    view.strideInBytes = slot->strideInBytes;
+                    view.data = (const uint8_t *)slot + align( sizeof( SharedSlotHeader ) );
+                    view.sequence = sequence;
+                    view.slot = slot;
+                    if ( isIntact( view ) ) return true;
+                }
+                return false;
+            }
+
+            //! Whether the pixels behind \a view are still the frame it was
+            //! read as. Check after using them; if this fails they may have
+            //! been overwritten meanwhile.
+            bool isIntact( const SharedFrameView &view ) const
+            {
+                std::atomic_thread_fence( std::memory_order_acquire );
+                return view.slot != NULL && view.slot->sequence.load( std::memory_order_relaxed ) == view.sequence;
+            }
+
+            //! Whether the ring \a name belongs to a running publisher. A ring
+            //! still being set up counts as alive, one of an older layout as
+            //! not.
+            static bool isOwnerAlive( const std::string &name )
+            {
+                int fd = shm_open( name.c_str(), O_RDONLY, 0 );
+                if ( fd < 0 ) return false;
+
+                struct stat info;
+                bool isAlive = true;
+                if ( fstat( fd, &info ) == 0 && (size_t)info.st_size >= sizeof( SharedRingHeader ) ) {
+                    void *memory = mmap( NULL, sizeof( SharedRingHeader ), PROT_READ, MAP_SHARED, fd, 0 );
+                    if ( memory != MAP_FAILED ) {
+                        const SharedRingHeader *header = (const SharedRingHeader *)memory;
+                        if ( header->magic.load( std::memory_order_acquire ) == SHARED_RING_MAGIC ) {
+                            isAlive = header->version == SHARED_RING_VERSION && header->isClosed.load( std::memory_order_acquire ) == 0
+                                      && ( kill( header->ownerPid, 0 ) == 0 || errno == EPERM );
+                        }
+                        munmap( memory, sizeof( SharedRingHeader ) );
+                    }
+                }
+                ::close( fd );
+                return isAlive;
+            }
+
+            static size_t align( size_t size )
+            {
+                return ( size + SHARED_RING_ALIGNMENT - 1 ) / SHARED_RING_ALIGNMENT * SHARED_RING_ALIGNMENT;
+            }
+
+        private:
+            SharedRingHeader *header;
+            size_t mappedSize;
+            bool isOwner;
+            std::string name;
+
+            // not copyable, the mapping is released once
+            SharedFrameRing( const SharedFrameRing & );
+            SharedFrameRing & operator=( const SharedFrameRing & );
+
+            SharedSlotHeader * getSlot( uint64_t index ) const
+            {
+                return (SharedSlotHeader *)( (uint8_t *)header + align( sizeof( SharedRingHeader ) ) + index * header->slotStride );
+            }
+        };
+
+        //! Name of the ring holding \a stream ("depth" or "color") of the
+        //! publisher \a name.
+        inline std::string getSharedRingName( const std::string &name, const char *stream )
+        {
+            return "/cinder-openni-" + name + "-" + stream;
+        }
+    }
+}
+
+#endif
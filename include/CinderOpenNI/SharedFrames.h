@@ -0,0 +1,126 @@
+#pragma once
+
+#include "CinderOpenNI/CameraCore.h"
+#include "CinderOpenNI/SharedFrameRing.h"
+
+#if !defined( _WIN32 )
+
+namespace cinder {
+    namespace openni {
+        //! Publishes the frames a camera reads to shared memory, so other
+        //! processes can use the one physically opened sensor through
+        //! SharedCamera (or the SharedMemory OpenNI driver). Each stream goes
+        //! into its own ring of slotCount frames; frames are copied into it
+        //! once, on the thread that read them, and never again however many
+        //! processes read them.
+        class SharedFramePublisher {
+        public:
+            SharedFramePublisher();
+            ~SharedFramePublisher();
+
+            //! Publishes \a camera's depth and color frames under \a name.
+            //! Call after camera.setup(); the rings are created on the first
+            //! frame of each stream.
+            void start( CameraCore &camera, const std::string &name, int slotCount=8 );
+            //! Removes the rings, subscribers wait for them to come back.
+            void stop();
+            bool isStarted() const { return camera != NULL; }
+
+        private:
+            struct Stream {
+                Stream() : bytesPerPixel( 0 ), callbackId( 0 ), isFailed( false ) {}
+
+                SharedFrameRing ring;
+                std::string ringName;
+                SharedRingFormat format;
+                int bytesPerPixel;
+                //! 0 while no callback is registered
+                CallbackId callbackId;
+                //! creating the ring failed, don't retry every frame
+                bool isFailed;
+            };
+
+            void setupStream( Stream &stream, const std::string &name, const char *streamName, _openni::SensorType sensorType, Vec2f fov,
+                              int maxValue );
+            //! Runs on the reading thread.
+            void publish( Stream &stream, const FrameEvent &event );
+
+            CameraCore *camera;
+            Stream depth, color;
+            int slotCount;
+
+            // not copyable, callbacks point at this
+            SharedFramePublisher( const SharedFramePublisher & );
+            SharedFramePublisher & operator=( const SharedFramePublisher & );
+        };
+
+        //! Reads the frames a SharedFramePublisher in another process
+        //! publishes under the same name, straight from shared memory.
+        class SharedCamera {
+        public:
+            SharedCamera();
+
+            //! Reads the rings published under \a name. The publisher may
+            //! start later, or restart; update() keeps looking for it.
+            void setup( const std::string &name );
+            //! Picks up the newest published frames, never waits. Returns
+            //! true if one of them is new.
+            bool update();
+            void close();
+
+            //! Whether the publisher's depth or color ring is mapped.
+            bool hasDepth() const { return depth.ring->isOpen(); }
+            bool hasColor() const { return color.ring->isOpen(); }
+
+            //! Wraps the depth frame picked up by update() in the ring,
+            //! without copying. The channel keeps the ring mapped, but the
+            //! ring is read only and the publisher overwrites the frame once
+            //! it has gone around it, so copy the channel to keep the frame
+            //! or check isDepthIntact() after using it.
+            Channel16u getDepthChannel16u();
+            //! Same as getDepthChannel16u(), for color.
+            Surface8u getColorSurface();
+            //! Whether the current frame's pixels are still in the ring.
+            bool isDepthIntact() const { return depth.ring->isOpen() && depth.ring->isIntact( depth.frame ); }
+            bool isColorIntact() const { return color.ring->isOpen() && color.ring->isIntact( color.frame ); }
+            //! Timestamp, frame index and pixels of the current frames.
+            const SharedFrameView & getDepthFrame() const { return depth.frame; }
+            const SharedFrameView & getColorFrame() const { return color.frame; }
+
+            Vec2i getDepthSize() const { return Vec2i( depth.frame.width, depth.frame.height ); }
+            Vec2i getColorSize() const { return Vec2i( color.frame.width, color.frame.height ); }
+            //! As CameraCore::getDepthMetadata() on the publishing side.
+            CameraCore::DepthMetadata getDepthMetadata() const;
+            //! Horizontal and vertical field of view in radians.
+            Vec2f getDepthFieldOfView() const;
+
+            //! Published frames update() didn't get to see, because newer
+            //! ones were published before it was called.
+            uint64_t getDepthFramesSkipped() const { return depth.framesSkipped; }
+            uint64_t getColorFramesSkipped() const { return color.framesSkipped; }
+
+        private:
+            struct Stream {
+                Stream() : ring( new SharedFrameRing() ), framesSkipped( 0 ), viewFrameNumber( 0 ), hasView( false ) {}
+
+                //! shared with the channels and surfaces wrapping its frames
+                std::shared_ptr< SharedFrameRing > ring;
+                std::string ringName;
+                SharedFrameView frame;
+                uint64_t framesSkipped;
+                //! frame the channel or surface wraps
+                uint64_t viewFrameNumber;
+                bool hasView;
+            };
+
+            bool updateStream( Stream &stream );
+            void closeRing( Stream &stream );
+
+            Stream depth, color;
+            Channel16u depthChannel;
+            Surface8u colorSurface;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cinder {
+    namespace openni {
+        class RowExecutor;
+
+        //! Cleans up single depth frames for geometry: removes flying
+        //! pixels (the in-between depths sensors report across silhouette
+        //! edges), fills small holes and smooths surfaces without smearing
+        //! them across edges. Each stage looks at 3x3 neighborhoods and runs
+        //! as one pass over the frame, split into row tiles across threads.
+        class SpatialDepthFilter {
+        public:
+            enum STAGES {
+                STAGE_FLYING_PIXELS = 0x1,
+                STAGE_HOLE_FILL = 0x2,
+                STAGE_SMOOTH = 0x4
+            };
+
+            SpatialDepthFilter();
+
+            //! Stages to run, in the order listed above. All by default.
+            void setStages( int _stages ) { stages = _stages; }
+            int getStages() const { return stages; }
+            //! A pixel that differs by more than this (in depth units) from
+            //! both of its horizontal or both of its vertical neighbors is
+            //! dropped. 100 by default.
+            void setFlyingPixelThreshold( uint16_t threshold ) { flyingPixelThreshold = threshold; }
+            uint16_t getFlyingPixelThreshold() const { return flyingPixelThreshold; }
+            //! Valid pixels out of the 8 around a hole needed to fill it, 3
+            //! by default. Holes are filled from the farthest neighbor, as
+            //! the holes around silhouettes are shadows on the background.
+            void setHoleFillNeighbors( int neighbors ) { holeFillNeighbors = neighbors; }
+            int getHoleFillNeighbors() const { return holeFillNeighbors; }
+            //! Neighbors further than this from a pixel's depth are left out
+            //! of its average, which keeps edges sharp. 30 by default.
+            void setSmoothThreshold( uint16_t threshold ) { smoothThreshold = threshold; }
+            uint16_t getSmoothThreshold() const { return smoothThreshold; }
+
+            //! Filters a frame. \a executor splits the rows across threads.
+            void apply( const uint16_t *depth, int strideInBytes, int width, int height, RowExecutor *executor = NULL );
+
+            //! width * height filtered depth values, stays at the same
+            //! address while the size doesn't change.
+            const uint16_t * getData() const { return filtered.data(); }
+            uint16_t * getData() { return filtered.data(); }
+            int getWidth() const { return width; }
+            int getHeight() const { return height; }
+
+            //! Single row kernels, exposed for benchmarking. Each reads the
+            //! rows above and below \a row and writes \a width pixels to
+            //! \a out; the first and last pixel are copied.
+            static void removeFlyingPixelsRowScalar( const uint16_t *above, const uint16_t *row, const uint16_t *below, uint16_t *out,
+                                                     int width, uint16_t threshold );
+            static void removeFlyingPixelsRow( const uint16_t *above, const uint16_t *row, const uint16_t *below, uint16_t *out,
+                                               int width, uint16_t threshold );
+            static void fillHolesRowScalar( const uint16_t *above, const uint16_t *row, const uint16_t *below, uint16_t *out,
+                                            int width, int neighbors );
+            static void fillHolesRow( const uint16_t *above, const uint16_t *row, const uint16_t *below, uint16_t *out,
+                                      int width, int neighbors );
+            //! Invalid pixels stay invalid.
+            static void smoothRowScalar( const uint16_t *above, const uint16_t *row, const uint16_t *below, uint16_t *out,
+                                         int width, uint16_t threshold );
+            static void smoothRow( const uint16_t *above, const uint16_t *row, const uint16_t *below, uint16_t *out,
+                                   int width, uint16_t threshold );
+
+        private:
+            void filterRows( int stage, const uint16_t *src, int strideInBytes, uint16_t *dst, int beginRow, int endRow );
+
+            int stages;
+            uint16_t flyingPixelThreshold;
+            int holeFillNeighbors;
+            uint16_t smoothThreshold;
+
+            int width, height;
+            std::vector< uint16_t > filtered;
+            //! output of the stages before the last
+            std::vector< uint16_t > scratch;
+        };
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace cinder {
+    namespace openni {
+        //! Monotonic host time in microseconds, for latency measurements.
+        uint64_t getHostTimeUs();
+
+        struct Percentiles {
+            uint32_t p50, p95, p99, max;
+            //! samples the percentiles were computed from, at most
+            //! RollingSamples::CAPACITY
+            size_t count;
+        };
+
+        //! The last CAPACITY values of a measurement. add() is wait-free,
+        //! so it can sit on the capture path, as long as there is a single
+        //! writer; readers on other threads may see a mix of old and new
+        //! samples, which doesn't matter for percentiles.
+        class RollingSamples {
+        public:
+            enum { CAPACITY = 256 };
+
+            RollingSamples();
+
+            void add( uint32_t value )
+            {
+                uint32_t index = next.load( std::memory_order_relaxed );
+                samples[index % CAPACITY].store( value, std::memory_order_relaxed );
+                next.store( index + 1, std::memory_order_release );
+            }
+
+            //! Sorts a copy of the samples, don't call it per frame.
+            Percentiles getPercentiles() const;
+
+        private:
+            std::atomic< uint32_t > samples[CAPACITY];
+            std::atomic< uint32_t > next;
+
+            // not copyable
+            RollingSamples( const RollingSamples & );
+            RollingSamples & operator=( const RollingSamples & );
+        };
+
+        //! Times a scope into \a samples, in microseconds.
+        class ScopedSample {
+        public:
+            ScopedSample( RollingSamples &samples ) : samples( samples ), start( getHostTimeUs() ) {}
+            ~ScopedSample() { samples.add( (uint32_t)( getHostTimeUs() - start ) ); }
+
+        private:
+            RollingSamples &samples;
+            uint64_t start;
+
+            ScopedSample & operator=( const ScopedSample & );
+        };
+    }
+}
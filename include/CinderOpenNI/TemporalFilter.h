@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cinder {
+    namespace openni {
+        class RowExecutor;
+
+        //! Smooths depth over time, taking out the flicker structured light
+        //! sensors show at edges and long range. The filtered depth is a
+        //! persistent 16 bit buffer updated in place by every frame applied.
+        //! Pixels whose depth jumps by more than the reset threshold start
+        //! over from the new reading, so moving objects don't leave trails.
+        class TemporalDepthFilter {
+        public:
+            enum MODES {
+                //! exponential moving average
+                TEMPORAL_AVERAGE,
+                //! median of the last few frames
+                TEMPORAL_MEDIAN
+            };
+
+            enum { MAX_MEDIAN_FRAMES = 5 };
+
+            TemporalDepthFilter();
+
+            //! Switching modes starts over.
+            void setMode( int mode );
+            int getMode() const { return mode; }
+            //! Weight of the newest frame in TEMPORAL_AVERAGE, in (0, 1].
+            //! Lower is smoother but lags more. 0.25 by default.
+            void setAverageWeight( float weight );
+            float getAverageWeight() const { return averageWeight / 256.0f; }
+            //! 3 (the default) or 5 frames. Starts over.
+            void setMedianFrames( int frames );
+            int getMedianFrames() const { return medianFrames; }
+            //! Change in depth units above which a pixel is taken to have
+            //! moved and restarts from the new reading. 0 never resets.
+            //! 100 by default.
+            void setResetThreshold( uint16_t threshold ) { resetThreshold = threshold; }
+            uint16_t getResetThreshold() const { return resetThreshold; }
+
+            //! Forgets the history, the next frame passes through unfiltered.
+            void reset() { hasHistory = false; }
+
+            //! Filters one more frame. \a executor splits the rows across
+            //! threads. Changing size starts over.
+            void apply( const uint16_t *depth, int strideInBytes, int width, int height, RowExecutor *executor = NULL );
+
+            //! width * height filtered depth values.
+            const uint16_t * getData() const { return filtered.data(); }
+            uint16_t * getData() { return filtered.data(); }
+            int getWidth() const { return width; }
+            int getHeight() const { return height; }
+
+            //! Single row kernels, exposed for benchmarking. \a weight is in
+            //! 256ths, and pixels changing by more than \a threshold reset.
+            //! An invalid (0) reading or filtered value passes the reading
+            //! through.
+            static void averageRowScalar( const uint16_t *depth, uint16_t *filtered, int count, int weight, uint16_t threshold );
+            static void averageRow( const uint16_t *depth, uint16_t *filtered, int count, int weight, uint16_t threshold );
+            //! Stores \a depth in history[newest] (or in every history row,
+            //! if the pixel reset) and writes the median of the \a frames
+            //! history rows to \a filtered. Invalid readings take part in
+            //! the median, so single dropouts get filled.
+            static void medianRowScalar( uint16_t *const *history, int frames, int newest, const uint16_t *depth, uint16_t *filtered,
+                                         int count, uint16_t threshold );
+            static void medianRow( uint16_t *const *history, int frames, int newest, const uint16_t *depth, uint16_t *filtered,
+                                   int count, uint16_t threshold );
+
+        private:
+            void filterRows( const uint16_t *depth, int strideInBytes, int beginRow, int endRow );
+
+            int mode;
+            int averageWeight;
+            int medianFrames;
+            uint16_t resetThreshold;
+
+            int width, height;
+            bool hasHistory;
+            std::vector< uint16_t > filtered;
+            //! medianFrames planes of width * height, used as a ring
+            std::vector< uint16_t > history;
+            int historyNewest;
+        };
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "CinderOpenNI/Stats.h"
+#include <atomic>
+#include <string>
+
+namespace cinder {
+    namespace openni {
+        //! Collects timing markers from every thread and writes them as a
+        //! Chrome trace, for chrome://tracing or ui.perfetto.dev. Markers
+        //! are only compiled in with CINDER_OPENNI_TRACE defined, and only
+        //! recorded while tracing is enabled.
+        class Trace {
+        public:
+            static void setEnabled( bool enabled );
+            static bool isEnabled() { return enabled.load( std::memory_order_relaxed ); }
+            //! Writes everything recorded so far. Returns false if \a path
+            //! can't be written.
+            static bool write( const std::string &path );
+            //! Forgets everything recorded so far. Only while disabled.
+            static void clear();
+
+            //! Shown for the calling thread in the trace. \a name must
+            //! outlive the trace, like marker names. Does nothing while
+            //! tracing is disabled, so call it where the thread does work.
+            static void setThreadName( const char *name );
+            //! \a name must be a string literal, only the pointer is kept.
+            static void record( const char *name, uint64_t startUs, uint64_t endUs );
+
+        private:
+            static std::atomic< bool > enabled;
+        };
+
+        class TraceScope {
+        public:
+            TraceScope( const char *_name ) : name( Trace::isEnabled() ? _name : NULL ), start( name ? getHostTimeUs() : 0 ) {}
+            ~TraceScope() { if ( name ) Trace::record( name, start, getHostTimeUs() ); }
+
+        private:
+            const char *name;
+            uint64_t start;
+        };
+    }
+}
+
+#if defined( CINDER_OPENNI_TRACE )
+#   define CI_OPENNI_TRACE_CONCAT_( a, b ) a##b
+#   define CI_OPENNI_TRACE_CONCAT( a, b ) CI_OPENNI_TRACE_CONCAT_( a, b )
+#   define CI_OPENNI_TRACE_SCOPE( name ) ::cinder::openni::TraceScope CI_OPENNI_TRACE_CONCAT( traceScope, __LINE__ )( name )
+#   define CI_OPENNI_TRACE_THREAD( name ) ::cinder::openni::Trace::setThreadName( name )
+#else
+#   define CI_OPENNI_TRACE_SCOPE( name )
+#   define CI_OPENNI_TRACE_THREAD( name )
+#endif
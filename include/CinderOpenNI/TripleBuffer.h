@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+
+namespace cinder {
+    namespace openni {
+        //! Lock-free exchange between exactly one producer and one consumer.
+        //! The producer fills back() and publish()es it, the consumer
+        //! consume()s and reads front(). Neither side ever waits, and the
+        //! slot the consumer is reading is never handed back to the producer
+        //! until the consumer asks for a newer one.
+        template < typename T >
+        class TripleBuffer {
+        public:
+            TripleBuffer() :
+            backIndex( 0 ), middle( 1 ), frontIndex( 2 )
+            {
+            }
+
+            //! Slot owned by the producer.
+            T & back() { return slots[backIndex]; }
+
+            //! Slot owned by the consumer.
+            T & front() { return slots[frontIndex]; }
+            const T & front() const { return slots[frontIndex]; }
+
+            //! Hands back() to the consumer and takes a free slot in its
+            //! place. Returns true if a previously published slot was
+            //! replaced before the consumer saw it.
+            bool publish()
+            {
+                int previous = middle.exchange( backIndex | DIRTY, std::memory_order_acq_rel );
+                backIndex = previous & INDEX_MASK;
+                return ( previous & DIRTY ) != 0;
+            }
+
+            //! Moves the most recently published slot to front(). Returns
+            //! false, leaving front() untouched, if nothing new was published.
+            bool consume()
+            {
+                if ( ( middle.load( std::memory_order_acquire ) & DIRTY ) == 0 ) return false;
+
+                int previous = middle.exchange( frontIndex, std::memory_order_acq_rel );
+                frontIndex = previous & INDEX_MASK;
+                return true;
+            }
+
+        private:
+            enum {
+                INDEX_MASK = 0x3,
+                DIRTY = 0x4
+            };
+
+            // not copyable
+            TripleBuffer( const TripleBuffer & );
+            TripleBuffer & operator=( const TripleBuffer & );
+
+            T slots[3];
+            int backIndex;
+            std::atomic< int > middle;
+            int frontIndex;
+        };
+    }
+}
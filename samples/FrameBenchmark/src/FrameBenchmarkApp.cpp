@@ -0,0 +1,280 @@
+// Times every stage of the block's frame path on live frames: publishing,
+// depth conversion, image sources, texture uploads, point clouds and
+// registration, then end-to-end throughput with a capture thread. Prints a
+// table to the console and quits.
+//
+// The frame path is meant not to allocate once warmed up. Stages that should
+// stay allocation free are checked, and the app exits with a failure status
+// if any of them allocated.
+//
+// Pass a device URI or .oni file on the command line, by default it runs on
+// the synthetic driver (drivers/Synthetic) as fast as it renders:
+//
+//     FrameBenchmark synthetic://?fps=0
+
+#include "cinder/app/AppNative.h"
+#include "cinder/gl/gl.h"
+#include "cinder/gl/Texture.h"
+#include "CinderOpenNI.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <new>
+
+using namespace ci;
+using namespace ci::app;
+using namespace std;
+
+#if defined( _MSC_VER )
+#   define BENCHMARK_THREAD_LOCAL __declspec( thread )
+#else
+#   define BENCHMARK_THREAD_LOCAL __thread
+#endif
+
+// Allocations made by the benchmarking thread, so the driver's and the
+// capture thread's don't count against the stage being timed.
+static BENCHMARK_THREAD_LOCAL size_t allocationCount = 0;
+
+void * operator new( size_t size )
+{
+    ++allocationCount;
+    void *p = std::malloc( size ? size : 1 );
+    if ( p == NULL ) throw std::bad_alloc();
+    return p;
+}
+
+void * operator new[]( size_t size )
+{
+    return operator new( size );
+}
+
+void operator delete( void *p ) throw()
+{
+    std::free( p );
+}
+
+void operator delete[]( void *p ) throw()
+{
+    std::free( p );
+}
+
+class FrameBenchmarkApp : public AppNative {
+public:
+    void prepareSettings( Settings *settings );
+	void setup();
+	void draw();
+
+private:
+    struct Stage {
+        const char *name;
+        std::function< void () > run;
+        size_t bytesPerFrame;
+        //! on the steady state frame path, so it mustn't allocate
+        bool isAllocationFree;
+        double totalNs;
+        size_t allocations;
+    };
+
+    //! Return false if an allocation free stage allocated.
+    bool benchmarkStages( const std::string &uri );
+    bool benchmarkThroughput( const std::string &uri );
+};
+
+static const int FRAMES = 300;
+static const double THROUGHPUT_SECONDS = 3.0;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double elapsedNs( Clock::time_point start )
+{
+    return (double)std::chrono::duration_cast< std::chrono::nanoseconds >( Clock::now() - start ).count();
+}
+
+static void report( const char *name, double nsPerFrame, size_t bytesPerFrame, double allocationsPerFrame )
+{
+    console() << std::fixed;
+    console().precision( 0 );
+    console() << std::setw( 30 ) << std::left << name << std::right << std::setw( 12 ) << nsPerFrame << " ns/frame";
+    console().precision( 1 );
+    console() << std::setw( 10 ) << ( bytesPerFrame ? bytesPerFrame / nsPerFrame * 1e3 : 0.0 ) << " MB/s";
+    console() << std::setw( 8 ) << allocationsPerFrame << " allocs/frame" << endl;
+}
+
+static bool checkAllocations( const char *name, size_t allocations )
+{
+    if ( allocations == 0 ) return true;
+    console() << "FAILED: " << name << " allocated " << allocations << " times after warming up" << endl;
+    return false;
+}
+
+static void reportLatency( const char *name, const ci::openni::Percentiles &percentiles )
+{
+    console() << std::setw( 30 ) << std::left << name << std::right << std::setw( 12 ) << percentiles.p50 << " us p50"
+              << std::setw( 8 ) << percentiles.p95 << " p95" << std::setw( 8 ) << percentiles.p99 << " p99" << endl;
+}
+
+void FrameBenchmarkApp::prepareSettings( Settings *settings )
+{
+    settings->setWindowSize( 320, 240 );
+}
+
+void FrameBenchmarkApp::setup()
+{
+    // the textures need a GL context, which setup() has
+    std::string uri = getArgs().size() > 1 ? getArgs()[1] : "synthetic://?fps=0";
+    bool isPassed = false;
+    try {
+        isPassed = benchmarkStages( uri );
+        isPassed = benchmarkThroughput( uri ) && isPassed;
+    }
+    catch ( ci::openni::Camera::CameraException & ) {
+        console() << "Could not open " << uri << endl;
+    }
+    ci::openni::Camera::shutdown();
+    if ( !isPassed ) std::exit( EXIT_FAILURE );
+    quit();
+}
+
+void FrameBenchmarkApp::draw()
+{
+	gl::clear( Color( 0, 0, 0 ) );
+}
+
+// Every stage runs once per new depth/color pair, in blocking mode so
+// everything happens on this thread.
+bool FrameBenchmarkApp::benchmarkStages( const std::string &uri )
+{
+    ci::openni::Camera camera;
+    camera.setup( uri, ci::openni::Camera::SENSOR_DEPTH | ci::openni::Camera::SENSOR_COLOR );
+
+    bool hasDepth = false, hasColor = false;
+    camera.onDepthFrame( [&] ( const ci::openni::FrameEvent & ) { hasDepth = true; } );
+    camera.onColorFrame( [&] ( const ci::openni::FrameEvent & ) { hasColor = true; } );
+
+    Vec2i depthSize = camera.getDepthSize(), colorSize = camera.getColorSize();
+    size_t depthBytes = depthSize.x * depthSize.y * sizeof( uint16_t );
+    size_t colorBytes = colorSize.x * colorSize.y * 3;
+    size_t depth8Bytes = depthSize.x * depthSize.y;
+
+    // loading image sources into new channels and surfaces allocates by
+    // design, and so does wrapping a frame in a Cinder channel
+    Stage stages[] = {
+        { "getDepthImage (convert)", [&] { camera.getDepthImage(); }, depthBytes + depth8Bytes, true },
+        { "ImageSourceDepth::load", [&] { Channel8u( camera.getDepthImage() ); }, depth8Bytes, false },
+        { "getRawDepthImage", [&] { camera.getRawDepthImage(); }, 0, true },
+        { "ImageSourceRawDepth::load", [&] { Channel16u( camera.getRawDepthImage() ); }, depthBytes, false },
+        { "getColorImage", [&] { camera.getColorImage(); }, 0, true },
+        { "ImageSourceColor::load", [&] { Surface8u( camera.getColorImage() ); }, colorBytes, false },
+        { "getDepthChannel16u", [&] { camera.getDepthChannel16u(); }, 0, false },
+        { "getDepthTex (upload)", [&] { camera.getDepthTex(); }, depth8Bytes, true },
+        { "getRawDepthTex (upload)", [&] { camera.getRawDepthTex(); }, depthBytes, true },
+        { "getColorTex (upload)", [&] { camera.getColorTex(); }, colorBytes, true },
+        { "getFilteredDepthImage", [&] { camera.getFilteredDepthImage(); }, depthBytes * 2, true },
+        { "getFilteredDepthTex (upload)", [&] { camera.getFilteredDepthTex(); }, depthBytes, true },
+        { "getCleanDepthImage", [&] { camera.getCleanDepthImage(); }, depthBytes * 6, true },
+        { "getCleanDepthTex (upload)", [&] { camera.getCleanDepthTex(); }, depthBytes, true },
+        { "getPointCloud", [&] { camera.getPointCloud(); }, depthBytes * 7, true },
+        { "getNormals", [&] { camera.getNormals(); }, depthBytes * 12, true },
+        { "getRegisteredDepthChannel", [&] { camera.getRegisteredDepthChannel(); }, depthBytes * 2, true }
+    };
+    const int stageCount = sizeof( stages ) / sizeof( stages[0] );
+    for ( int s = 0; s < stageCount; ++s ) {
+        stages[s].totalNs = 0;
+        stages[s].allocations = 0;
+    }
+
+    double updateNs = 0;
+    size_t updateAllocations = 0;
+    for ( int frame = -10; frame < FRAMES; ++frame ) {
+        // warm up on the first few frames, tables get built there
+        bool isMeasured = frame >= 0;
+
+        hasDepth = hasColor = false;
+        while ( !hasDepth || !hasColor ) {
+            size_t allocations = allocationCount;
+            Clock::time_point start = Clock::now();
+            camera.update();
+            if ( isMeasured ) {
+                updateNs += elapsedNs( start );
+                updateAllocations += allocationCount - allocations;
+            }
+        }
+
+        for ( int s = 0; s < stageCount; ++s ) {
+            size_t allocations = allocationCount;
+            Clock::time_point start = Clock::now();
+            stages[s].run();
+            if ( isMeasured ) {
+                stages[s].totalNs += elapsedNs( start );
+                stages[s].allocations += allocationCount - allocations;
+            }
+        }
+    }
+    glFinish();
+
+    console() << uri << ", depth " << depthSize << ", color " << colorSize << ", " << FRAMES << " frames" << endl;
+    report( "update (publish depth+color)", updateNs / FRAMES, depthBytes + colorBytes, updateAllocations / (double)FRAMES );
+    for ( int s = 0; s < stageCount; ++s ) {
+        report( stages[s].name, stages[s].totalNs / FRAMES, stages[s].bytesPerFrame, stages[s].allocations / (double)FRAMES );
+    }
+    console() << endl;
+
+    bool isPassed = checkAllocations( "update", updateAllocations );
+    for ( int s = 0; s < stageCount; ++s ) {
+        if ( stages[s].isAllocationFree ) isPassed = checkAllocations( stages[s].name, stages[s].allocations ) && isPassed;
+    }
+
+    camera.close();
+    return isPassed;
+}
+
+// Frames a capture thread reads while this thread keeps updating textures,
+// like an app would.
+bool FrameBenchmarkApp::benchmarkThroughput( const std::string &uri )
+{
+    ci::openni::Camera camera;
+    camera.setup( uri, ci::openni::Camera::SENSOR_DEPTH | ci::openni::Camera::SENSOR_COLOR, ci::openni::Camera::CAPTURE_THREADED );
+
+    std::atomic< int > readFrames( 0 );
+    camera.onDepthFrame( [&] ( const ci::openni::FrameEvent & ) { ++readFrames; } );
+
+    // warm up until both textures exist
+    while ( readFrames < 10 ) {
+        camera.update();
+        camera.getDepthTex();
+        camera.getColorTex();
+    }
+
+    int updates = 0;
+    size_t allocations = allocationCount;
+    Clock::time_point start = Clock::now();
+    while ( elapsedNs( start ) < THROUGHPUT_SECONDS * 1e9 ) {
+        camera.update();
+        camera.getDepthTex();
+        camera.getColorTex();
+        ++updates;
+    }
+    allocations = allocationCount - allocations;
+    double seconds = elapsedNs( start ) / 1e9;
+
+    console().precision( 1 );
+    console() << "threaded capture, " << THROUGHPUT_SECONDS << "s" << endl;
+    console() << std::setw( 30 ) << std::left << "depth frames read" << std::right << std::setw( 12 ) << readFrames / seconds << " fps" << endl;
+    console() << std::setw( 30 ) << std::left << "update + textures" << std::right << std::setw( 12 ) << updates / seconds << " per second" << endl;
+
+    ci::openni::Camera::Stats stats = camera.getStats();
+    console() << std::setw( 30 ) << std::left << "depth frames dropped" << std::right << std::setw( 12 ) << stats.depth.framesDropped << endl;
+    console() << std::setw( 30 ) << std::left << "depth frames skipped" << std::right << std::setw( 12 ) << stats.depth.framesSkipped
+              << " of " << stats.depth.framesRead << " read" << endl;
+    reportLatency( "depth read to publish", stats.depth.readToPublish );
+    reportLatency( "depth read to texture", stats.depth.readToTexture );
+    reportLatency( "texture upload", stats.textureUpload );
+
+    camera.close();
+    return checkAllocations( "update + textures", allocations );
+}
+
+CINDER_APP_NATIVE( FrameBenchmarkApp, RendererGl )
@@ -0,0 +1,477 @@
+// Micro-benchmarks for the block's CPU kernels. They don't depend on Cinder
+// or OpenNI, so this builds on any box:
+//
+//     cd samples/KernelBenchmark
+//     c++ -O2 -std=c++11 -I../../include -o KernelBenchmark
+//         src/KernelBenchmark.cpp ../../src/DepthConversion.cpp
+//         ../../src/DepthVisualizer.cpp ../../src/Parallel.cpp
+//         ../../src/PointCloud.cpp ../../src/Registration.cpp
+//         ../../src/TemporalFilter.cpp ../../src/SpatialFilter.cpp -pthread
+//
+// Every kernel is checked against its scalar version before it is timed.
+
+#include "CinderOpenNI/DepthConversion.h"
+#include "CinderOpenNI/DepthVisualizer.h"
+#include "CinderOpenNI/Parallel.h"
+#include "CinderOpenNI/PointCloud.h"
+#include "CinderOpenNI/Registration.h"
+#include "CinderOpenNI/SpatialFilter.h"
+#include "CinderOpenNI/TemporalFilter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <vector>
+
+using namespace cinder::openni;
+
+static const int WIDTH = 640;
+static const int HEIGHT = 480;
+static const int PIXELS = WIDTH * HEIGHT;
+static const int MAX_DEPTH = 10000;
+
+static volatile int maxPixelValue = MAX_DEPTH;
+
+// The conversion loop the block used before the SIMD kernels.
+static void convertDepthFloat( const uint16_t *src, uint8_t *dst, size_t count )
+{
+    float scale = ( 255.0 / (float)maxPixelValue );
+    for ( size_t i = 0; i < count; ++i ) {
+        dst[i] = (uint8_t)( src[i] * scale );
+    }
+}
+
+static double timeNsPerFrame( const std::function< void () > &run, int iterations = 500 )
+{
+    for ( int i = 0; i < 10; ++i ) run();
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for ( int i = 0; i < iterations; ++i ) run();
+    auto end = std::chrono::high_resolution_clock::now();
+
+    return std::chrono::duration_cast< std::chrono::nanoseconds >( end - start ).count() / (double)iterations;
+}
+
+static void report( const char *name, double nsPerFrame, double baseline, size_t bytesPerFrame )
+{
+    std::printf( "%-28s %10.0f ns/frame %8.1f MB/s %6.2fx\n", name, nsPerFrame,
+                 bytesPerFrame / nsPerFrame * 1e3, baseline / nsPerFrame );
+}
+
+static std::vector< uint16_t > makeDepth()
+{
+    std::vector< uint16_t > depth( PIXELS );
+    for ( int i = 0; i < PIXELS; ++i ) depth[i] = (uint16_t)( std::rand() % ( MAX_DEPTH + 1 ) );
+    return depth;
+}
+
+// Compares the SIMD kernels with the scalar one over all 16 bit values,
+// most of them far above maxValue.
+static bool checkDepthConversion( int maxValue )
+{
+    std::vector< uint16_t > depth( 65536 );
+    for ( int i = 0; i < 65536; ++i ) depth[i] = (uint16_t)i;
+
+    std::vector< uint8_t > expected( depth.size() ), actual( depth.size() );
+    uint32_t scale = getDepthScale( maxValue );
+    convertDepthTo8uScalar( depth.data(), expected.data(), depth.size(), scale );
+
+    int level = getSimdLevel();
+    bool ok = true;
+    if ( level >= SIMD_SSE2 ) {
+        convertDepthTo8uSse2( depth.data(), actual.data(), depth.size(), scale );
+        ok = ok && actual == expected;
+    }
+    if ( level >= SIMD_AVX2 ) {
+        convertDepthTo8uAvx2( depth.data(), actual.data(), depth.size(), scale );
+        ok = ok && actual == expected;
+    }
+    if ( !ok ) std::printf( "depth conversion: wrong output for maxValue %d\n", maxValue );
+    return ok;
+}
+
+static bool benchmarkDepthConversion()
+{
+    static const int maxValues[] = { 1, 3, 100, 254, 255, 256, 1000, MAX_DEPTH, 65535 };
+    for ( size_t i = 0; i < sizeof( maxValues ) / sizeof( maxValues[0] ); ++i ) {
+        if ( !checkDepthConversion( maxValues[i] ) ) return false;
+    }
+
+    std::vector< uint16_t > depth = makeDepth();
+    std::vector< uint8_t > actual( PIXELS );
+    uint32_t scale = getDepthScale( MAX_DEPTH );
+    int level = getSimdLevel();
+
+    const uint16_t *src = depth.data();
+    uint8_t *dst = actual.data();
+    size_t bytes = PIXELS * ( sizeof( uint16_t ) + sizeof( uint8_t ) );
+
+    std::printf( "depth 16 -> 8 bit, %dx%d\n", WIDTH, HEIGHT );
+    double baseline = timeNsPerFrame( [&] { convertDepthFloat( src, dst, PIXELS ); } );
+    report( "float (previous)", baseline, baseline, bytes );
+    report( "scalar", timeNsPerFrame( [&] { convertDepthTo8uScalar( src, dst, PIXELS, scale ); } ), baseline, bytes );
+    if ( level >= SIMD_SSE2 )
+        report( "sse2", timeNsPerFrame( [&] { convertDepthTo8uSse2( src, dst, PIXELS, scale ); } ), baseline, bytes );
+    if ( level >= SIMD_AVX2 )
+        report( "avx2", timeNsPerFrame( [&] { convertDepthTo8uAvx2( src, dst, PIXELS, scale ); } ), baseline, bytes );
+    std::printf( "\n" );
+
+    return true;
+}
+
+static bool benchmarkDepthVisualizer()
+{
+    std::vector< uint16_t > depth = makeDepth();
+    std::vector< uint8_t > out( PIXELS * 3 );
+    const uint16_t *src = depth.data();
+    uint8_t *dst = out.data();
+
+    DepthVisualizer visualizer;
+    visualizer.setMaxValue( MAX_DEPTH );
+    visualizer.setRange( 800, 3000 );
+
+    std::printf( "depth visualization lookup table, %dx%d, 800-3000\n", WIDTH, HEIGHT );
+    double baseline = timeNsPerFrame( [&] { convertDepthFloat( src, dst, PIXELS ); } );
+    report( "float (previous)", baseline, baseline, PIXELS * 3 );
+
+    static const char *names[] = { "grayscale", "turbo", "jet", "histogram" };
+    for ( int colormap = 0; colormap < 4; ++colormap ) {
+        visualizer.setColormap( colormap );
+        size_t bytes = PIXELS * ( sizeof( uint16_t ) + visualizer.getChannels() );
+        report( names[colormap], timeNsPerFrame( [&] { visualizer.apply( src, dst, PIXELS ); } ), baseline, bytes );
+    }
+    std::printf( "\n" );
+
+    return true;
+}
+
+// What CoordinateConverter::convertDepthToWorld does for every pixel.
+static void depthToWorldPerPixel( const uint16_t *depth, float *xyz, float xzFactor, float yzFactor )
+{
+    for ( int y = 0; y < HEIGHT; ++y ) {
+        for ( int x = 0; x < WIDTH; ++x, xyz += 3 ) {
+            float z = depth[y * WIDTH + x];
+            xyz[0] = ( (float)x / WIDTH - 0.5f ) * z * xzFactor;
+            xyz[1] = ( 0.5f - (float)y / HEIGHT ) * z * yzFactor;
+            xyz[2] = z;
+        }
+    }
+}
+
+static bool benchmarkPointCloud()
+{
+    const float hFov = 1.0144f, vFov = 0.7898f;
+    std::vector< uint16_t > depth = makeDepth();
+    std::vector< float > expected( PIXELS * 3 ), xyz( PIXELS * 3 ), x( PIXELS ), y( PIXELS ), z( PIXELS );
+    const uint16_t *src = depth.data();
+
+    PointCloudGenerator generator;
+    generator.setup( WIDTH, HEIGHT, hFov, vFov, 1.0f );
+    for ( int row = 0; row < HEIGHT; ++row ) generator.convertRowScalar( src + row * WIDTH, row, expected.data() + row * WIDTH * 3 );
+
+    RowExecutor executor( 4 );
+    generator.convert( src, 0, xyz.data(), &executor );
+    generator.convert( src, 0, x.data(), y.data(), z.data(), &executor );
+    for ( int i = 0; i < PIXELS; ++i ) {
+        bool same = xyz[i * 3] == expected[i * 3] && xyz[i * 3 + 1] == expected[i * 3 + 1] && xyz[i * 3 + 2] == expected[i * 3 + 2]
+                    && x[i] == expected[i * 3] && y[i] == expected[i * 3 + 1] && z[i] == expected[i * 3 + 2];
+        if ( !same ) {
+            std::printf( "point cloud: SIMD output differs from scalar at pixel %d\n", i );
+            return false;
+        }
+    }
+
+    float xzFactor = std::tan( hFov / 2.0f ) * 2.0f, yzFactor = std::tan( vFov / 2.0f ) * 2.0f;
+    size_t bytes = PIXELS * ( sizeof( uint16_t ) + 3 * sizeof( float ) );
+    float *out = xyz.data();
+
+    std::printf( "point cloud, %dx%d\n", WIDTH, HEIGHT );
+    double baseline = timeNsPerFrame( [&] { depthToWorldPerPixel( src, out, xzFactor, yzFactor ); } );
+    report( "per pixel formula", baseline, baseline, bytes );
+    report( "ray tables, scalar", timeNsPerFrame( [&] {
+        for ( int row = 0; row < HEIGHT; ++row ) generator.convertRowScalar( src + row * WIDTH, row, out + row * WIDTH * 3 );
+    } ), baseline, bytes );
+    report( "ray tables, Vec3f", timeNsPerFrame( [&] { generator.convert( src, 0, out ); } ), baseline, bytes );
+    report( "ray tables, SoA", timeNsPerFrame( [&] { generator.convert( src, 0, x.data(), y.data(), z.data() ); } ), baseline, bytes );
+    report( "ray tables, Vec3f, 4 threads", timeNsPerFrame( [&] { generator.convert( src, 0, out, &executor ); } ), baseline, bytes );
+    report( "ray tables, SoA, 4 threads", timeNsPerFrame( [&] { generator.convert( src, 0, x.data(), y.data(), z.data(), &executor ); } ), baseline, bytes );
+    std::printf( "\n" );
+
+    return true;
+}
+
+// A depth to color mapping shaped like a real one: a fixed offset plus a
+// disparity shift along the baseline.
+static bool mapDepthToColor( int x, int y, uint16_t z, int *colorX, int *colorY )
+{
+    *colorX = x - 12 + 30000 / ( z + 300 );
+    *colorY = y + 8;
+    return true;
+}
+
+// Like mapDepthToColor, but the disparity grows toward the image edges, as
+// with real intrinsics.
+static bool mapDepthToColorWide( int x, int y, uint16_t z, int *colorX, int *colorY )
+{
+    int fromCenter = std::abs( x - WIDTH / 2 ) + std::abs( y - HEIGHT / 2 );
+    *colorX = x - 12 + 30000 * ( 1000 + fromCenter ) / 1000 / ( z + 300 );
+    *colorY = y + 8;
+    return true;
+}
+
+// Largest distance in pixels between where the tables and \a depthToColor
+// put a pixel, over every pixel at a range of depths.
+static int getRegistrationError( const DepthRegistration &registration, const DepthRegistration::DepthToColor &depthToColor )
+{
+    int maxError = 0;
+    for ( int z = 400; z <= MAX_DEPTH; z += 100 ) {
+        for ( int y = 0; y < HEIGHT; ++y ) {
+            for ( int x = 0; x < WIDTH; ++x ) {
+                int expectedX, expectedY, actualX, actualY;
+                if ( !depthToColor( x, y, (uint16_t)z, &expectedX, &expectedY ) ) continue;
+                registration.map( x, y, (uint16_t)z, &actualX, &actualY );
+                maxError = std::max( maxError, std::abs( actualX - expectedX ) + std::abs( actualY - expectedY ) );
+            }
+        }
+    }
+    return maxError;
+}
+
+// What calling CoordinateConverter::convertDepthToColor for every pixel does.
+static void registerPerPixel( const uint16_t *depth, uint16_t *registered, const DepthRegistration::DepthToColor &depthToColor )
+{
+    std::memset( registered, 0, PIXELS * sizeof( uint16_t ) );
+    for ( int y = 0; y < HEIGHT; ++y ) {
+        for ( int x = 0; x < WIDTH; ++x ) {
+            uint16_t z = depth[y * WIDTH + x];
+            int colorX, colorY;
+            if ( z == 0 || !depthToColor( x, y, z, &colorX, &colorY ) ) continue;
+            if ( colorX < 0 || colorX >= WIDTH || colorY < 0 || colorY >= HEIGHT ) continue;
+            uint16_t &target = registered[colorY * WIDTH + colorX];
+            if ( target == 0 || z < target ) target = z;
+        }
+    }
+}
+
+static bool benchmarkRegistration()
+{
+    std::vector< uint16_t > depth = makeDepth();
+    std::vector< uint16_t > expected( PIXELS ), actual( PIXELS );
+    const uint16_t *src = depth.data();
+    uint16_t *dst = actual.data();
+    DepthRegistration::DepthToColor depthToColor = mapDepthToColor;
+
+    DepthRegistration registration;
+    registration.setup( WIDTH, HEIGHT, WIDTH, HEIGHT, MAX_DEPTH, depthToColor );
+    registerPerPixel( src, expected.data(), depthToColor );
+    registration.apply( src, 0, dst );
+    if ( actual != expected ) {
+        std::printf( "registration: table output differs from per pixel mapping\n" );
+        return false;
+    }
+
+    DepthRegistration wideRegistration;
+    wideRegistration.setup( WIDTH, HEIGHT, WIDTH, HEIGHT, MAX_DEPTH, mapDepthToColorWide );
+    int wideError = getRegistrationError( wideRegistration, mapDepthToColorWide );
+    // scaling the center's whole pixel shifts costs a few pixels, a shift
+    // that doesn't vary at all was 17 off at the edges
+    if ( wideError > 3 ) {
+        std::printf( "registration: tables off by %d pixels where disparity varies\n", wideError );
+        return false;
+    }
+
+    size_t bytes = PIXELS * 2 * sizeof( uint16_t );
+
+    std::printf( "depth to color registration, %dx%d\n", WIDTH, HEIGHT );
+    double baseline = timeNsPerFrame( [&] { registerPerPixel( src, dst, depthToColor ); }, 100 );
+    report( "per pixel mapping", baseline, baseline, bytes );
+    report( "lookup tables", timeNsPerFrame( [&] { registration.apply( src, 0, dst ); } ), baseline, bytes );
+    std::printf( "\n" );
+
+    return true;
+}
+
+// Depth that flickers by a few units from frame to frame, with dropouts and a
+// region that jumps, like something moving through the view.
+static void makeNoisyFrame( const std::vector< uint16_t > &scene, std::vector< uint16_t > &frame, int frameIndex )
+{
+    for ( int i = 0; i < PIXELS; ++i ) {
+        int z = scene[i] + std::rand() % 21 - 10;
+        if ( std::rand() % 50 == 0 ) z = 0;
+        if ( ( i % WIDTH ) < WIDTH / 4 && frameIndex % 2 == 1 ) z += 500;
+        frame[i] = (uint16_t)( z < 0 ? 0 : z > MAX_DEPTH ? MAX_DEPTH : z );
+    }
+}
+
+// Runs the per-row kernel \a filterRow (scalar or dispatched) over a few
+// frames, so history and resets are exercised.
+static std::vector< uint16_t > filterFrames( int mode, int frames, bool isScalar )
+{
+    std::srand( 1 );
+    std::vector< uint16_t > scene = makeDepth(), frame( PIXELS ), filtered( PIXELS ), history( PIXELS * frames );
+    for ( int f = 0; f < 8; ++f ) {
+        makeNoisyFrame( scene, frame, f );
+        if ( f == 0 ) {
+            filtered = frame;
+            for ( int i = 0; i < frames; ++i ) std::memcpy( &history[i * PIXELS], frame.data(), PIXELS * sizeof( uint16_t ) );
+            continue;
+        }
+        for ( int y = 0; y < HEIGHT; ++y ) {
+            const uint16_t *row = &frame[y * WIDTH];
+            uint16_t *out = &filtered[y * WIDTH];
+            if ( mode == TemporalDepthFilter::TEMPORAL_MEDIAN ) {
+                uint16_t *rows[TemporalDepthFilter::MAX_MEDIAN_FRAMES];
+                for ( int i = 0; i < frames; ++i ) rows[i] = &history[i * PIXELS + y * WIDTH];
+                if ( isScalar ) TemporalDepthFilter::medianRowScalar( rows, frames, f % frames, row, out, WIDTH, 100 );
+                else TemporalDepthFilter::medianRow( rows, frames, f % frames, row, out, WIDTH, 100 );
+            }
+            else {
+                if ( isScalar ) TemporalDepthFilter::averageRowScalar( row, out, WIDTH, 64, 100 );
+                else TemporalDepthFilter::averageRow( row, out, WIDTH, 64, 100 );
+            }
+        }
+    }
+    return filtered;
+}
+
+static bool benchmarkTemporalFilter()
+{
+    static const char *names[] = { "average", "median of 3", "median of 5" };
+    static const int modes[] = { TemporalDepthFilter::TEMPORAL_AVERAGE, TemporalDepthFilter::TEMPORAL_MEDIAN, TemporalDepthFilter::TEMPORAL_MEDIAN };
+    static const int frames[] = { 1, 3, 5 };
+
+    for ( int m = 0; m < 3; ++m ) {
+        if ( filterFrames( modes[m], frames[m], false ) != filterFrames( modes[m], frames[m], true ) ) {
+            std::printf( "temporal filter: %s SIMD output differs from scalar\n", names[m] );
+            return false;
+        }
+    }
+
+    std::vector< uint16_t > scene = makeDepth(), frame( PIXELS );
+    makeNoisyFrame( scene, frame, 0 );
+    const uint16_t *src = frame.data();
+    RowExecutor executor( 4 );
+
+    std::printf( "temporal filter, %dx%d\n", WIDTH, HEIGHT );
+    for ( int m = 0; m < 3; ++m ) {
+        TemporalDepthFilter filter;
+        filter.setMode( modes[m] );
+        filter.setMedianFrames( frames[m] );
+        filter.setResetThreshold( 100 );
+        size_t bytes = PIXELS * sizeof( uint16_t ) * ( 2 + frames[m] );
+
+        char name[64];
+        std::sprintf( name, "%s", names[m] );
+        double single = timeNsPerFrame( [&] { filter.apply( src, 0, WIDTH, HEIGHT ); } );
+        report( name, single, single, bytes );
+        std::sprintf( name, "%s, 4 threads", names[m] );
+        report( name, timeNsPerFrame( [&] { filter.apply( src, 0, WIDTH, HEIGHT, &executor ); } ), single, bytes );
+    }
+    std::printf( "\n" );
+
+    return true;
+}
+
+// A box in front of a wall with noise, holes and flying pixels along the
+// box's edges.
+static std::vector< uint16_t > makeScene()
+{
+    std::vector< uint16_t > depth( PIXELS );
+    for ( int y = 0; y < HEIGHT; ++y ) {
+        for ( int x = 0; x < WIDTH; ++x ) {
+            bool isBox = x > WIDTH / 4 && x < WIDTH * 3 / 4 && y > HEIGHT / 4 && y < HEIGHT * 3 / 4;
+            bool isEdge = isBox && ( x == WIDTH / 4 + 1 || x == WIDTH * 3 / 4 - 1 );
+            int z = isBox ? 1500 : 3000;
+            if ( isEdge ) z = 1500 + std::rand() % 1500;
+            z += std::rand() % 11 - 5;
+            if ( std::rand() % 20 == 0 ) z = 0;
+            depth[y * WIDTH + x] = (uint16_t)z;
+        }
+    }
+    return depth;
+}
+
+static bool benchmarkSpatialFilter()
+{
+    std::vector< uint16_t > scene = makeScene(), expected( PIXELS ), actual( PIXELS );
+    const uint16_t *src = scene.data();
+
+    static const char *names[] = { "flying pixels", "hole fill", "smooth" };
+    for ( int stage = 0; stage < 3; ++stage ) {
+        for ( int y = 1; y < HEIGHT - 1; ++y ) {
+            const uint16_t *above = src + ( y - 1 ) * WIDTH, *row = src + y * WIDTH, *below = src + ( y + 1 ) * WIDTH;
+            uint16_t *e = &expected[y * WIDTH], *a = &actual[y * WIDTH];
+            switch ( stage ) {
+                case 0:
+                    SpatialDepthFilter::removeFlyingPixelsRowScalar( above, row, below, e, WIDTH, 100 );
+                    SpatialDepthFilter::removeFlyingPixelsRow( above, row, below, a, WIDTH, 100 );
+                    break;
+                case 1:
+                    SpatialDepthFilter::fillHolesRowScalar( above, row, below, e, WIDTH, 3 );
+                    SpatialDepthFilter::fillHolesRow( above, row, below, a, WIDTH, 3 );
+                    break;
+                default:
+                    SpatialDepthFilter::smoothRowScalar( above, row, below, e, WIDTH, 30 );
+                    SpatialDepthFilter::smoothRow( above, row, below, a, WIDTH, 30 );
+                    break;
+            }
+        }
+        if ( actual != expected ) {
+            std::printf( "spatial filter: %s SIMD output differs from scalar\n", names[stage] );
+            return false;
+        }
+    }
+
+    RowExecutor executor( 4 );
+    SpatialDepthFilter filter;
+    size_t bytes = PIXELS * sizeof( uint16_t ) * 2 * 3;
+
+    // all three stages with the scalar kernels
+    auto scalarStages = [&] {
+        uint16_t *buffers[2] = { expected.data(), actual.data() };
+        const uint16_t *in = src;
+        for ( int stage = 0; stage < 3; ++stage ) {
+            uint16_t *out = buffers[stage % 2];
+            for ( int y = 1; y < HEIGHT - 1; ++y ) {
+                const uint16_t *above = in + ( y - 1 ) * WIDTH, *row = in + y * WIDTH, *below = in + ( y + 1 ) * WIDTH;
+                if ( stage == 0 ) SpatialDepthFilter::removeFlyingPixelsRowScalar( above, row, below, out + y * WIDTH, WIDTH, 100 );
+                else if ( stage == 1 ) SpatialDepthFilter::fillHolesRowScalar( above, row, below, out + y * WIDTH, WIDTH, 3 );
+                else SpatialDepthFilter::smoothRowScalar( above, row, below, out + y * WIDTH, WIDTH, 30 );
+            }
+            in = out;
+        }
+    };
+
+    // the goal is under 1ms per frame on 4 cores
+    std::printf( "spatial filter (flying pixels, hole fill, smooth), %dx%d\n", WIDTH, HEIGHT );
+    double baseline = timeNsPerFrame( scalarStages, 100 );
+    report( "scalar", baseline, baseline, bytes );
+    report( "simd", timeNsPerFrame( [&] { filter.apply( src, 0, WIDTH, HEIGHT ); } ), baseline, bytes );
+    report( "simd, 4 threads", timeNsPerFrame( [&] { filter.apply( src, 0, WIDTH, HEIGHT, &executor ); } ), baseline, bytes );
+    std::printf( "\n" );
+
+    return true;
+}
+
+int main()
+{
+    static const char *levels[] = { "none", "sse2", "avx2" };
+    std::printf( "SIMD level: %s\n", levels[getSimdLevel()] );
+    // The "4 threads" rows only mean something with at least 4 cores.
+    std::printf( "hardware threads: %u\n\n", std::thread::hardware_concurrency() );
+
+    bool ok = true;
+    ok = benchmarkDepthConversion() && ok;
+    ok = benchmarkDepthVisualizer() && ok;
+    ok = benchmarkPointCloud() && ok;
+    ok = benchmarkRegistration() && ok;
+    ok = benchmarkTemporalFilter() && ok;
+    ok = benchmarkSpatialFilter() && ok;
+
+    return ok ? 0 : 1;
+}
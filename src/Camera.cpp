@@ -1,295 +1,223 @@
 #include "CinderOpenNI.h"
 #include "CinderOpenNI/Camera.h"
+#include "CinderOpenNI/Trace.h"
 #include "cinder/app/AppBasic.h"
 
 
 namespace cinder { namespace openni {
-    void handleStatus(_openni::Status &status, std::string message)
-    {
-        if ( status == _openni::STATUS_OK ) return;
-
-        app::console() << message << ": " << _openni::OpenNI::getExtendedError() << std::endl;
-        Camera::shutdown();
-		throw Camera::CameraException();
-    }
-
-
-    bool Camera::initialized = false;
-
-    void Camera::initialize()
-    {
-        if ( initialized ) return;
-        _openni::Status status = _openni::STATUS_OK;
-        status = _openni::OpenNI::initialize();
-        handleStatus(status, "Error initializing OpenNI");
-        initialized = true;
-    }
-
-    void Camera::shutdown()
-    {
-        if ( !initialized ) return;
-
-        _openni::OpenNI::shutdown();
-        initialized = false;
-    }
-
     Camera::Camera() :
-    allStreams(NULL)
-    {}
-
-    Camera::~Camera()
+    usePbo(false)
     {
-        if ( allStreams != NULL ) {
-            delete []allStreams;
-        }
-    }
-
-    int Camera::setupStream(_openni::VideoStream &stream, _openni::SensorType sensorType )
-    {
-        _openni::Status status = _openni::STATUS_OK;
-
-        std::string description = sensorType == _openni::SENSOR_COLOR ? "color stream" : "depth stream";
-
-        status = stream.create(device, sensorType);
-        handleStatus( status, "Could not find " + description );
-
-        status = stream.start();
-        if ( status != _openni::STATUS_OK ) stream.destroy();
-        handleStatus( status, "Could not start " + description );
-
-
-        if ( !stream.isValid() ) {
-            app::console() << description << " is not valid.";
-            throw Camera::CameraException();
-        }
-
-
-        _openni::VideoMode mode = stream.getVideoMode();
-        Vec2i size = Vec2i( mode.getResolutionX(), mode.getResolutionY() );
-
-        int index = all.size();
-        all.push_back( FrameData( stream, size ) );
-        allStreams[index] = &stream;
-
-        return index;
+        if ( logStream == NULL ) setLogStream( app::console() );
     }
 
-    void Camera::setup(int enableSensors)
+    void Camera::setPboEnabled( bool enabled )
     {
-        _openni::Status status = _openni::STATUS_OK;
-
-
-        initialize();
-
-        status = device.open(_openni::ANY_DEVICE);
-        handleStatus( status, "Could not open device" );
-
-        allStreams = new _openni::VideoStream*[2];
-        allStreams[0] = NULL;
-        allStreams[1] = NULL;
-
-
-        if ( (enableSensors & SENSOR_DEPTH) == SENSOR_DEPTH ) {
-            depthIndex = setupStream( depthStream, _openni::SENSOR_DEPTH );
-        }
-
-        if ( (enableSensors & SENSOR_COLOR) == SENSOR_COLOR ) {
-            colorIndex = setupStream( colorStream, _openni::SENSOR_COLOR );
-        }
-
-        if ( !depthStream.isValid() && !colorStream.isValid() ) {
-            app::console() << "No valid OpenNI streams." << std::endl;
-            throw Camera::CameraException();
-        }
-    }
-
-    void Camera::update()
-    {
-        int changedStreamIndex;
-
-        _openni::Status status = _openni::OpenNI::waitForAnyStream(allStreams, all.size(), &changedStreamIndex);
-        if ( status != _openni::STATUS_OK ) {
-            app::console() << "Waiting for new OpenNI data failed." << std::endl;
-            return;
-        }
-
-        updateStream( changedStreamIndex );
-    }
-
-    void Camera::updateStream( int streamIndex )
-    {
-        FrameData &frame = getFrameData( streamIndex );
-        frame.stream.readFrame( &frame.frameRef );
-        frame.isImageFresh = false;
-        frame.isTexFresh = false;
-
-        // FIXME: not so nice :(
-        if ( streamIndex == depthIndex ) {
-            scaledDepthFrameData.isImageFresh = false;
-            scaledDepthFrameData.isTexFresh = false;
-        }
+        usePbo = enabled;
+        for ( auto &t : streamTexes ) t->usePbo = enabled;
+        scaledDepthTex.usePbo = enabled;
+        filteredDepthTex.usePbo = enabled;
+        cleanDepthTex.usePbo = enabled;
     }
 
     void Camera::close()
     {
-        for ( auto &f : all ) {
-            f.stream.stop();
-            f.stream.destroy();
-        }
-        device.close();
+        CameraCore::close();
+
+        // generations start over with the next device's frames
+        streamTexes.clear();
+        scaledDepthTex.reset();
+        filteredDepthTex.reset();
+        cleanDepthTex.reset();
     }
 
     /**************************************************************************
-     * getters
+     * TexData
      */
-    ImageSourceRef Camera::getDepthImage()
+    template <>
+    Camera::TexData::TexFormat Camera::TexData::getTexFormat< _openni::RGB888Pixel >()
     {
-        scaledDepthFrameData.updateOriginal( &getFrameData(depthIndex) );
-        scaledDepthFrameData.updateImage< uint8_t, ImageSourceDepth, _openni::DepthPixel >();
-        return scaledDepthFrameData.imageRef;
+        TexFormat texFormat = { GL_RGB, GL_UNSIGNED_BYTE, GL_RGB8, 3 };
+        return texFormat;
     }
 
-    ImageSourceRef Camera::getRawDepthImage()
+    template <>
+    Camera::TexData::TexFormat Camera::TexData::getTexFormat< _openni::DepthPixel >()
     {
-        FrameData &frame = getFrameData( depthIndex );
-        frame.updateImage< _openni::DepthPixel, ImageSourceRawDepth >();
-        return frame.imageRef;
+#if defined( GL_R16 )
+        TexFormat texFormat = { GL_RED, GL_UNSIGNED_SHORT, GL_R16, 2 };
+#else
+        TexFormat texFormat = { GL_LUMINANCE, GL_UNSIGNED_SHORT, GL_LUMINANCE16, 2 };
+#endif
+        return texFormat;
     }
 
-    ImageSourceRef Camera::getColorImage()
+    template <>
+    Camera::TexData::TexFormat Camera::TexData::getTexFormat< uint8_t >()
     {
-        FrameData &frame = getFrameData( colorIndex );
-        frame.updateImage< _openni::RGB888Pixel, ImageSourceColor >();
-        return frame.imageRef;
+        TexFormat texFormat = { GL_LUMINANCE, GL_UNSIGNED_BYTE, GL_LUMINANCE8, 1 };
+        return texFormat;
     }
 
-    gl::Texture & Camera::getDepthTex()
+    Camera::TexData::TexData() :
+    texInternalFormat( 0 ),
+    generation( 0 ),
+    usePbo( false ),
+    pboIndex( 0 )
     {
-        scaledDepthFrameData.updateOriginal( &getFrameData(depthIndex) );
-        scaledDepthFrameData.updateTex< uint8_t, ImageSourceDepth, _openni::DepthPixel >();
-        return scaledDepthFrameData.tex;
+        pbos[0] = pbos[1] = 0;
     }
 
-    gl::Texture & Camera::getRawDepthTex()
+    Camera::TexData::~TexData()
     {
-        FrameData &frame = getFrameData( depthIndex );
-        frame.updateTex< _openni::DepthPixel, ImageSourceRawDepth >();
-        return frame.tex;
+        if ( pbos[0] != 0 ) glDeleteBuffers( 2, pbos );
     }
 
-    gl::Texture & Camera::getColorTex()
+    void Camera::TexData::reset()
     {
-        FrameData &frame = getFrameData( colorIndex );
-        frame.updateTex< _openni::RGB888Pixel, ImageSourceColor >();
-        return frame.tex;
+        tex = gl::Texture();
+        texInternalFormat = 0;
+        generation = 0;
     }
 
-    Camera::FrameData & Camera::getFrameData( int index )
+    void Camera::TexData::allocateTex( Vec2i size, const TexFormat &texFormat )
     {
-        return all.at( index );
-    }
+        gl::Texture::Format format;
+        format.setInternalFormat( texFormat.internalFormat );
+        tex = gl::Texture( size.x, size.y, format );
+        texInternalFormat = texFormat.internalFormat;
 
-    /**************************************************************************
-     * FrameDataAbstract
-     */
-    Camera::FrameDataAbstract::FrameDataAbstract( Vec2i size ) :
-    isImageFresh( false ), isTexFresh( false ),
-	size( size )
-    {
+#if defined( GL_TEXTURE_SWIZZLE_RGBA )
+        // sample single channel textures as gray, like luminance ones
+        if ( texFormat.format == GL_RED ) {
+            GLint swizzle[] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+            tex.bind();
+            glTexParameteriv( tex.getTarget(), GL_TEXTURE_SWIZZLE_RGBA, swizzle );
+            tex.unbind();
+        }
+#endif
     }
 
-    void Camera::FrameDataAbstract::initTexture( Vec2i _size )
+    void Camera::TexData::uploadTex( Vec2i size, const void *data, int strideInBytes, const TexFormat &texFormat )
     {
-        imageRef = ImageSourceRef( Surface8u(_size.x, _size.y, false) );
-        tex = gl::Texture( imageRef );
+        CI_OPENNI_TRACE_SCOPE( "uploadTex" );
+        if ( !tex || tex.getWidth() != size.x || tex.getHeight() != size.y || texInternalFormat != texFormat.internalFormat ) {
+            allocateTex( size, texFormat );
+        }
+
+        int rowBytes = size.x * texFormat.bytesPerPixel;
+        if ( strideInBytes == 0 ) strideInBytes = rowBytes;
+
+        tex.bind();
+        glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+
+        if ( usePbo ) {
+            if ( pbos[0] == 0 ) glGenBuffers( 2, pbos );
+
+            // alternate buffers and orphan the old storage, so we never wait
+            // for the previous upload to finish reading it
+            glBindBuffer( GL_PIXEL_UNPACK_BUFFER, pbos[pboIndex] );
+            pboIndex = 1 - pboIndex;
+            glBufferData( GL_PIXEL_UNPACK_BUFFER, rowBytes * size.y, NULL, GL_STREAM_DRAW );
+
+            uint8_t *dst = (uint8_t *)glMapBuffer( GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY );
+            if ( dst != NULL ) {
+                const uint8_t *src = (const uint8_t *)data;
+                if ( strideInBytes == rowBytes ) {
+                    memcpy( dst, src, rowBytes * size.y );
+                }
+                else {
+                    for ( int y = 0; y < size.y; ++y ) memcpy( dst + y * rowBytes, src + y * strideInBytes, rowBytes );
+                }
+                glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER );
+                glTexSubImage2D( tex.getTarget(), 0, 0, 0, size.x, size.y, texFormat.format, texFormat.type, NULL );
+            }
+            glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+        }
+        else {
+            glPixelStorei( GL_UNPACK_ROW_LENGTH, strideInBytes / texFormat.bytesPerPixel );
+            glTexSubImage2D( tex.getTarget(), 0, 0, 0, size.x, size.y, texFormat.format, texFormat.type, data );
+            glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+        }
+
+        glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+        tex.unbind();
     }
 
     /**************************************************************************
-     * FrameData
+     * getters
      */
-    Camera::FrameData::FrameData( _openni::VideoStream &stream, Vec2i size ) :
-    stream(stream),
-    FrameDataAbstract( size )
+    template < typename pixel_t >
+    gl::Texture & Camera::updateStreamTex( int streamIndex )
     {
-        initTexture(size);
-    }
+        FrameData &frame = getFrameData( streamIndex );
+        while ( (int)streamTexes.size() <= streamIndex ) {
+            streamTexes.push_back( std::shared_ptr< TexData >( new TexData() ) );
+            streamTexes.back()->usePbo = usePbo;
+        }
 
-    template < typename pixel_t, typename image_t >
-    void Camera::FrameData::updateImage()
-    {
-        if ( isImageFresh || !frameRef.isValid() ) return;
+        TexData &texData = *streamTexes[streamIndex];
+        TexData::TexFormat texFormat = TexData::getTexFormat< pixel_t >();
+        if ( !texData.tex ) texData.allocateTex( frame.size, texFormat );
 
-        pixel_t *data = (pixel_t *)frameRef.getData();
-        imageRef = ImageSourceRef( new image_t( data, size.x, size.y ) );
-        isImageFresh = true;
+        if ( texData.generation != frame.getGeneration() && frame.frameRef.isValid() ) {
+            ScopedSample sample( textureUploadSamples );
+            frame.readToTexture.add( (uint32_t)( getHostTimeUs() - frame.frameReadTime ) );
+            texData.uploadTex( frame.size, frame.frameRef.getData(), frame.frameRef.getStrideInBytes(), texFormat );
+            texData.generation = frame.getGeneration();
+        }
+        return texData.tex;
     }
 
-    template < typename pixel_t, typename image_t >
-    void Camera::FrameData::updateTex()
+    gl::Texture & Camera::getDepthTex()
     {
-        if ( isTexFresh ) return;
+        DerivedFrameData &frame = updateScaledDepth();
+        TexData::TexFormat texFormat = frame.visualizer.getChannels() == 3 ? TexData::getTexFormat< _openni::RGB888Pixel >()
+                                                                           : TexData::getTexFormat< uint8_t >();
+        if ( !scaledDepthTex.tex ) scaledDepthTex.allocateTex( frame.size, texFormat );
 
-        updateImage< pixel_t, image_t >();
-        tex = gl::Texture( imageRef );
-        isTexFresh = true;
+        if ( scaledDepthTex.generation != frame.getGeneration() && frame.isFresh() ) {
+            ScopedSample sample( textureUploadSamples );
+            frame.original->readToTexture.add( (uint32_t)( getHostTimeUs() - frame.original->frameReadTime ) );
+            scaledDepthTex.uploadTex( frame.size, frame.convertedData, 0, texFormat );
+            scaledDepthTex.generation = frame.getGeneration();
+        }
+        return scaledDepthTex.tex;
     }
 
-	/**************************************************************************
-     * DerivedFrameData
-     */
-    Camera::DerivedFrameData::DerivedFrameData() :
-    original( NULL ),
-    FrameDataAbstract( Vec2i::zero() ),
-    convertedData( NULL )
+    template < typename filter_t >
+    gl::Texture & Camera::updateFilteredTex( FilteredFrameData< filter_t > &frame, TexData &texData )
     {
-    }
+        TexData::TexFormat texFormat = TexData::getTexFormat< _openni::DepthPixel >();
+        if ( !texData.tex ) texData.allocateTex( frame.size, texFormat );
+        if ( !frame.isFresh() ) return texData.tex;
 
-    Camera::DerivedFrameData::~DerivedFrameData()
-    {
-        if ( convertedData != NULL ) delete []convertedData;
+        if ( texData.generation != frame.getGeneration() ) {
+            ScopedSample sample( textureUploadSamples );
+            texData.uploadTex( frame.size, frame.filter.getData(), 0, texFormat );
+            texData.generation = frame.getGeneration();
+        }
+        return texData.tex;
     }
 
-    void Camera::DerivedFrameData::updateOriginal( FrameData *_original )
+    gl::Texture & Camera::getFilteredDepthTex()
     {
-        if ( original == NULL ) {
-            initTexture( _original->size );
-        }
-
-        size = _original->size;
-        original = _original;
+        return updateFilteredTex( updateFilteredDepth(), filteredDepthTex );
     }
 
-    template < typename pixel_t, typename image_t, typename original_pixel_t >
-    void Camera::DerivedFrameData::updateImage()
+    gl::Texture & Camera::getCleanDepthTex()
     {
-        if ( isImageFresh || original == NULL || !original->frameRef.isValid() ) return;
-
-        original_pixel_t *originalData = (original_pixel_t *)original->frameRef.getData();
-        convertData( originalData, &convertedData );
-        imageRef = ImageSourceRef( new image_t( convertedData, size.x, size.y ) );
-
-        isImageFresh = true;
+        return updateFilteredTex( updateCleanDepth(), cleanDepthTex );
     }
 
-    template < typename pixel_t, typename image_t, typename original_pixel_t >
-    void Camera::DerivedFrameData::updateTex()
+    gl::Texture & Camera::getRawDepthTex()
     {
-        if ( isTexFresh ) return;
-
-        updateImage< pixel_t, image_t, original_pixel_t >();
-        tex = gl::Texture( imageRef );
-        isTexFresh = true;
+        return updateStreamTex< _openni::DepthPixel >( depthIndex );
     }
 
-    void Camera::DerivedFrameData::convertData( const _openni::DepthPixel *originalData, uint8_t **_convertedData )
+    gl::Texture & Camera::getColorTex()
     {
-        int _size = size.x * size.y;
-        float scale = (255.0 / (float)original->stream.getMaxPixelValue());
-        if ( *_convertedData == NULL ) *_convertedData = new uint8_t[_size];
-
-        for ( int i = 0; i < _size; ++i ) {
-            (*_convertedData)[i] = (uint8_t)(originalData[i] * scale);
-        }
+        return updateStreamTex< _openni::RGB888Pixel >( colorIndex );
     }
 
-} }
\ No newline at end of file
+} }
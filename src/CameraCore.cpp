@@ -0,0 +1,1130 @@
+#include "CinderOpenNI/CameraCore.h"
+#include "CinderOpenNI/DepthConversion.h"
+#include "CinderOpenNI/Trace.h"
+#include <iostream>
+
+
+namespace cinder { namespace openni {
+    void handleStatus(_openni::Status &status, std::string message)
+    {
+        if ( status == _openni::STATUS_OK ) return;
+
+        // OpenNI stays initialized, other cameras may still be using it
+        CameraCore::log() << message << ": " << _openni::OpenNI::getExtendedError() << std::endl;
+		throw CameraCore::CameraException();
+    }
+
+
+    bool CameraCore::initialized = false;
+    std::ostream *CameraCore::logStream = NULL;
+
+    void CameraCore::setLogStream( std::ostream &stream )
+    {
+        logStream = &stream;
+    }
+
+    std::ostream & CameraCore::log()
+    {
+        return logStream != NULL ? *logStream : std::cerr;
+    }
+
+    void CameraCore::initialize()
+    {
+        if ( initialized ) return;
+        _openni::Status status = _openni::STATUS_OK;
+        status = _openni::OpenNI::initialize();
+        handleStatus(status, "Error initializing OpenNI");
+        initialized = true;
+    }
+
+    void CameraCore::shutdown()
+    {
+        if ( !initialized ) return;
+
+        _openni::OpenNI::shutdown();
+        initialized = false;
+    }
+
+    // How long the capture thread waits for data before checking whether it
+    // should exit.
+    static const int CAPTURE_TIMEOUT_MS = 100;
+
+    CameraCore::CameraCore() :
+    depthIndex(-1),
+    colorIndex(-1),
+    pointCloudSource(DEPTH_RAW),
+    hasCustomRegistration(false),
+    syncEnabled(false),
+    syncTolerance(0),
+    stallTimeout(0),
+    stallAction(STALL_NOTIFY),
+    captureMode(CAPTURE_BLOCKING),
+    isCapturing(false),
+    nextCallbackId(1)
+    {}
+
+    CameraCore::~CameraCore()
+    {
+        stopCapture();
+        dispatcher.stop();
+    }
+
+    std::vector< _openni::DeviceInfo > CameraCore::enumerateDevices()
+    {
+        initialize();
+
+        _openni::Array< _openni::DeviceInfo > deviceInfos;
+        _openni::OpenNI::enumerateDevices( &deviceInfos );
+
+        std::vector< _openni::DeviceInfo > devices;
+        for ( int i = 0; i < deviceInfos.getSize(); ++i ) devices.push_back( deviceInfos[i] );
+        return devices;
+    }
+
+    int CameraCore::setupStream(_openni::VideoStream &stream, _openni::SensorType sensorType )
+    {
+        _openni::Status status = _openni::STATUS_OK;
+
+        std::string description = sensorType == _openni::SENSOR_COLOR ? "color stream" : "depth stream";
+
+        status = stream.create(device, sensorType);
+        handleStatus( status, "Could not find " + description );
+
+        status = stream.start();
+        if ( status != _openni::STATUS_OK ) stream.destroy();
+        handleStatus( status, "Could not start " + description );
+
+
+        if ( !stream.isValid() ) {
+            log() << description << " is not valid.";
+            throw CameraCore::CameraException();
+        }
+
+
+        _openni::VideoMode mode = stream.getVideoMode();
+        Vec2i size = Vec2i( mode.getResolutionX(), mode.getResolutionY() );
+
+        int index = all.size();
+        all.push_back( FrameDataRef( new FrameData( stream, size ) ) );
+        allStreams.push_back( &stream );
+
+        return index;
+    }
+
+    void CameraCore::setup(int enableSensors, int _captureMode)
+    {
+        setupDevice( _openni::ANY_DEVICE, enableSensors, _captureMode );
+    }
+
+    void CameraCore::setup(const std::string &uri, int enableSensors, int _captureMode)
+    {
+        setupDevice( uri.c_str(), enableSensors, _captureMode );
+    }
+
+    void CameraCore::setupDevice(const char *uri, int enableSensors, int _captureMode)
+    {
+        _openni::Status status = _openni::STATUS_OK;
+
+
+        initialize();
+
+        status = device.open(uri);
+        handleStatus( status, "Could not open device" );
+
+
+        if ( (enableSensors & SENSOR_DEPTH) == SENSOR_DEPTH ) {
+            depthIndex = setupStream( depthStream, _openni::SENSOR_DEPTH );
+        }
+
+        if ( (enableSensors & SENSOR_COLOR) == SENSOR_COLOR ) {
+            colorIndex = setupStream( colorStream, _openni::SENSOR_COLOR );
+        }
+
+        if ( !depthStream.isValid() && !colorStream.isValid() ) {
+            log() << "No valid OpenNI streams." << std::endl;
+            throw CameraCore::CameraException();
+        }
+
+        setupDerivedNodes();
+
+        captureMode = _captureMode;
+        if ( captureMode == CAPTURE_THREADED || captureMode == CAPTURE_LISTENER ) startCapture();
+    }
+
+    bool CameraCore::update( int timeoutMs )
+    {
+        CI_OPENNI_TRACE_SCOPE( "Camera::update" );
+
+        if ( stallTimeout > 0 ) checkStalls();
+
+        bool isPublished = false;
+        if ( captureMode == CAPTURE_THREADED || captureMode == CAPTURE_LISTENER ) {
+            for ( int i = 0; i < (int)all.size(); ++i ) {
+                isPublished = publishStream( i ) || isPublished;
+            }
+            // with sync on, streams only queue frames until they pair up
+            if ( syncEnabled ) isPublished = publishSyncedFrames();
+            return isPublished;
+        }
+
+        if ( captureMode == CAPTURE_POLL ) timeoutMs = 0;
+
+        int changedStreamIndex;
+
+        _openni::Status status;
+        {
+            CI_OPENNI_TRACE_SCOPE( "waitForAnyStream" );
+            // a long wait is exactly when a stream stalls, so wake up at
+            // least once per stall timeout to look
+            bool isForever = timeoutMs == _openni::TIMEOUT_FOREVER;
+            bool isWatching = stallTimeout > 0 && ( isForever || timeoutMs > stallTimeout );
+            uint64_t waitStart = getHostTimeUs();
+            int waitMs = isWatching ? stallTimeout : timeoutMs;
+            for ( ;; ) {
+                status = _openni::OpenNI::waitForAnyStream(&allStreams[0], all.size(), &changedStreamIndex, waitMs);
+                if ( status != _openni::STATUS_TIME_OUT || !isWatching ) break;
+
+                checkStalls();
+                if ( !isForever ) {
+                    int waitedMs = (int)( ( getHostTimeUs() - waitStart ) / 1000 );
+                    if ( waitedMs >= timeoutMs ) break;
+                    waitMs = std::min( stallTimeout, timeoutMs - waitedMs );
+                }
+            }
+        }
+        if ( status == _openni::STATUS_TIME_OUT ) return false;
+        if ( status != _openni::STATUS_OK ) {
+            log() << "Waiting for new OpenNI data failed." << std::endl;
+            return false;
+        }
+
+        updateStream( changedStreamIndex );
+
+        // drain the other streams that are ready too, so a stream that lost
+        // the race doesn't wait a whole update
+        for ( int i = 0; i < (int)all.size(); ++i ) {
+            if ( i == changedStreamIndex ) continue;
+
+            int readyIndex;
+            if ( _openni::OpenNI::waitForAnyStream( &allStreams[i], 1, &readyIndex, 0 ) == _openni::STATUS_OK ) {
+                updateStream( i );
+            }
+        }
+
+        if ( syncEnabled ) return publishSyncedFrames();
+        return true;
+    }
+
+    void CameraCore::setStallTimeout( int stallMs, int _stallAction )
+    {
+        stallTimeout = stallMs;
+        stallAction = _stallAction;
+
+        // a stream isn't stalled for the time the watchdog was off
+        uint64_t now = getHostTimeUs();
+        for ( auto &f : all ) f->lastReadTime = now;
+    }
+
+    void CameraCore::checkStalls()
+    {
+        uint64_t now = getHostTimeUs();
+        for ( int i = 0; i < (int)all.size(); ++i ) {
+            FrameData &frame = getFrameData( i );
+            uint64_t stalledUs = now - std::min( now, frame.lastReadTime.load() );
+            if ( stalledUs < (uint64_t)stallTimeout * 1000 ) {
+                frame.isStalled = false;
+                continue;
+            }
+            if ( frame.isStalled ) continue;
+
+            frame.isStalled = true;
+            ++frame.stalls;
+            log() << ( i == depthIndex ? "Depth" : "Color" ) << " stream stalled for " << stalledUs / 1000 << "ms" << std::endl;
+
+            StallEvent event;
+            event.sensorType = frame.stream.getSensorInfo().getSensorType();
+            event.stalledMs = (uint32_t)( stalledUs / 1000 );
+            event.isRestarting = stallAction == STALL_RESTART;
+            if ( stallCallback ) stallCallback( event );
+
+            if ( stallAction == STALL_RESTART ) restartStream( i );
+        }
+    }
+
+    void CameraCore::restartStream( int streamIndex )
+    {
+        FrameData &frame = getFrameData( streamIndex );
+
+        // nothing may read the stream while it restarts
+        bool wasCapturing = isCapturing;
+        stopCapture();
+
+        frame.stream.stop();
+        if ( frame.stream.start() != _openni::STATUS_OK ) {
+            log() << "Could not restart stream: " << _openni::OpenNI::getExtendedError() << std::endl;
+        }
+        // give it a full timeout to come back before it counts as stalled again
+        frame.lastReadTime = getHostTimeUs();
+        frame.isStalled = false;
+
+        if ( wasCapturing ) startCapture();
+    }
+
+    void CameraCore::updateStream( int streamIndex )
+    {
+        CI_OPENNI_TRACE_SCOPE( "Camera::updateStream" );
+        readStream( streamIndex );
+        publishStream( streamIndex );
+    }
+
+    // Producer side: only ever called from the thread that reads the stream.
+    void CameraCore::readStream( int streamIndex )
+    {
+        FrameData &frame = getFrameData( streamIndex );
+        CapturedFrame &captured = frame.frameBuffer.back();
+        _openni::VideoFrameRef &frameRef = captured.frameRef;
+
+        CI_OPENNI_TRACE_SCOPE( "readFrame" );
+        uint64_t readStart = getHostTimeUs();
+        if ( frame.stream.readFrame( &frameRef ) != _openni::STATUS_OK ) return;
+        captured.readTime = getHostTimeUs();
+        frame.lastReadTime = captured.readTime;
+        frame.readDuration.add( (uint32_t)( captured.readTime - readStart ) );
+
+        // device and host clocks have different origins, so measure against
+        // the shortest delay seen
+        int64_t delay = (int64_t)captured.readTime - (int64_t)frameRef.getTimestamp();
+        if ( frame.framesRead == 0 || delay < frame.shortestDelay ) frame.shortestDelay = delay;
+        frame.deviceToRead.add( (uint32_t)( delay - frame.shortestDelay ) );
+
+        int frameIndex = frameRef.getFrameIndex();
+        if ( frame.framesRead > 0 && frameIndex > frame.lastFrameIndex + 1 ) {
+            frame.framesDropped += frameIndex - frame.lastFrameIndex - 1;
+        }
+        frame.lastFrameIndex = frameIndex;
+        ++frame.framesRead;
+
+        // dispatch before publishing, the slot is ours until then
+        dispatchFrame( frameRef );
+        if ( frame.frameBuffer.publish() ) ++frame.framesSkipped;
+    }
+
+    // Consumer side: the published frame stays referenced by frameRef (and by
+    // any image source built from it) after its slot is recycled, so readers
+    // never see it overwritten.
+    bool CameraCore::publishStream( int streamIndex )
+    {
+        FrameData &frame = getFrameData( streamIndex );
+        if ( !frame.frameBuffer.consume() ) return false;
+
+        CI_OPENNI_TRACE_SCOPE( "Camera::publishStream" );
+        ++frame.framesConsumed;
+        const CapturedFrame &captured = frame.frameBuffer.front();
+        frame.readToPublish.add( (uint32_t)( getHostTimeUs() - captured.readTime ) );
+
+        if ( syncEnabled ) {
+            // published later as part of a pair
+            frame.history[frame.historyNext] = captured;
+            frame.historyNext = ( frame.historyNext + 1 ) % FrameData::HISTORY_SIZE;
+            return true;
+        }
+
+        frame.frameRef = captured.frameRef;
+        frame.frameReadTime = captured.readTime;
+        invalidateStream( streamIndex );
+        return true;
+    }
+
+    void CameraCore::setSyncEnabled( bool enabled, uint64_t toleranceUs )
+    {
+        syncEnabled = enabled;
+        syncTolerance = toleranceUs;
+        if ( device.isValid() && !device.isFile() ) device.setDepthColorSyncEnabled( enabled );
+    }
+
+    // Publishes the newest depth/color pair within tolerance, if it is newer
+    // than what is currently published. Returns whether it published one.
+    bool CameraCore::publishSyncedFrames()
+    {
+        if ( depthIndex < 0 || colorIndex < 0 ) return false;
+
+        FrameData &depth = getFrameData( depthIndex );
+        FrameData &color = getFrameData( colorIndex );
+
+        int bestDepth = -1, bestColor = -1;
+        uint64_t bestTimestamp = 0;
+        for ( int d = 0; d < FrameData::HISTORY_SIZE; ++d ) {
+            if ( !depth.history[d].frameRef.isValid() ) continue;
+            uint64_t depthTimestamp = depth.history[d].frameRef.getTimestamp();
+
+            for ( int c = 0; c < FrameData::HISTORY_SIZE; ++c ) {
+                if ( !color.history[c].frameRef.isValid() ) continue;
+                uint64_t colorTimestamp = color.history[c].frameRef.getTimestamp();
+
+                uint64_t delta = depthTimestamp > colorTimestamp ? depthTimestamp - colorTimestamp : colorTimestamp - depthTimestamp;
+                uint64_t timestamp = depthTimestamp < colorTimestamp ? depthTimestamp : colorTimestamp;
+                if ( delta <= syncTolerance && ( bestDepth < 0 || timestamp > bestTimestamp ) ) {
+                    bestDepth = d;
+                    bestColor = c;
+                    bestTimestamp = timestamp;
+                }
+            }
+        }
+        if ( bestDepth < 0 ) return false;
+
+        const _openni::VideoFrameRef &depthFrame = depth.history[bestDepth].frameRef;
+        const _openni::VideoFrameRef &colorFrame = color.history[bestColor].frameRef;
+        bool isNewer = !depth.frameRef.isValid() || !color.frameRef.isValid()
+                       || depthFrame.getTimestamp() > depth.frameRef.getTimestamp()
+                       || colorFrame.getTimestamp() > color.frameRef.getTimestamp();
+        if ( !isNewer ) return false;
+
+        depth.frameRef = depthFrame;
+        depth.frameReadTime = depth.history[bestDepth].readTime;
+        color.frameRef = colorFrame;
+        color.frameReadTime = color.history[bestColor].readTime;
+        invalidateStream( depthIndex );
+        invalidateStream( colorIndex );
+        return true;
+    }
+
+    void CameraCore::invalidateStream( int streamIndex )
+    {
+        // everything derived from the stream goes stale with it
+        getFrameData( streamIndex ).touch();
+    }
+
+    void CameraCore::clearDerivedNodes()
+    {
+        DerivedNode *nodes[] = { &scaledDepthFrameData, &temporalDepthFrameData, &cleanDepthFrameData, &pointCloudNode, &pointCloudSoANode,
+                                 &normalsNode, &registeredDepthNode };
+        for ( size_t i = 0; i < sizeof( nodes ) / sizeof( nodes[0] ); ++i ) {
+            nodes[i]->clearInputs();
+            nodes[i]->setCompute( DerivedNode::ComputeFn() );
+        }
+        scaledDepthFrameData.original = NULL;
+    }
+
+    void CameraCore::setupDerivedNodes()
+    {
+        clearDerivedNodes();
+        if ( depthIndex < 0 ) return;
+
+        FrameData &depth = getFrameData( depthIndex );
+        scaledDepthFrameData.setOriginal( depth );
+        scaledDepthFrameData.setCompute( [this] () -> bool {
+            ScopedSample sample( depthConversionSamples );
+            return scaledDepthFrameData.updateData();
+        } );
+
+        // the size textures are allocated with before the first frame
+        temporalDepthFrameData.size = depth.size;
+        temporalDepthFrameData.addInput( depth );
+        temporalDepthFrameData.setCompute( [this] () -> bool {
+            CI_OPENNI_TRACE_SCOPE( "temporal filter" );
+            return filterDepth( temporalDepthFrameData, temporalFilterSamples );
+        } );
+        cleanDepthFrameData.size = depth.size;
+        cleanDepthFrameData.addInput( depth );
+        cleanDepthFrameData.setCompute( [this] () -> bool {
+            CI_OPENNI_TRACE_SCOPE( "spatial filter" );
+            return filterDepth( cleanDepthFrameData, spatialFilterSamples );
+        } );
+
+        pointCloudNode.addInput( getPointCloudInput() );
+        pointCloudNode.setCompute( [this] { return computePointCloud(); } );
+        pointCloudSoANode.addInput( getPointCloudInput() );
+        pointCloudSoANode.setCompute( [this] { return computePointCloudSoA(); } );
+        normalsNode.addInput( pointCloudNode );
+        normalsNode.setCompute( [this] { return computeNormals(); } );
+
+        if ( colorIndex >= 0 ) {
+            registeredDepthNode.addInput( depth );
+            registeredDepthNode.setCompute( [this] { return computeRegisteredDepth(); } );
+        }
+    }
+
+    void CameraCore::startCapture()
+    {
+        if ( isCapturing ) return;
+
+        isCapturing = true;
+        if ( captureMode == CAPTURE_LISTENER ) {
+            for ( int i = 0; i < (int)all.size(); ++i ) {
+                std::shared_ptr< StreamListener > listener( new StreamListener( *this, i ) );
+                getFrameData( i ).stream.addNewFrameListener( listener.get() );
+                listeners.push_back( listener );
+            }
+        }
+        else {
+            captureThread = std::thread( &CameraCore::captureLoop, this );
+        }
+    }
+
+    void CameraCore::stopCapture()
+    {
+        if ( !isCapturing ) return;
+
+        isCapturing = false;
+        for ( auto &listener : listeners ) {
+            getFrameData( listener->streamIndex ).stream.removeNewFrameListener( listener.get() );
+        }
+        listeners.clear();
+        if ( captureThread.joinable() ) captureThread.join();
+    }
+
+    void CameraCore::captureLoop()
+    {
+        while ( isCapturing ) {
+            CI_OPENNI_TRACE_THREAD( "OpenNI capture" );
+            int changedStreamIndex;
+
+            _openni::Status status;
+            {
+                CI_OPENNI_TRACE_SCOPE( "waitForAnyStream" );
+                status = _openni::OpenNI::waitForAnyStream(&allStreams[0], all.size(), &changedStreamIndex, CAPTURE_TIMEOUT_MS);
+            }
+            if ( status == _openni::STATUS_TIME_OUT ) continue;
+            if ( status != _openni::STATUS_OK ) {
+                log() << "Waiting for new OpenNI data failed." << std::endl;
+                std::this_thread::sleep_for( std::chrono::milliseconds( CAPTURE_TIMEOUT_MS ) );
+                continue;
+            }
+
+            readStream( changedStreamIndex );
+        }
+    }
+
+    CameraCore::StreamListener::StreamListener( CameraCore &camera, int streamIndex ) :
+    camera( camera ),
+    streamIndex( streamIndex )
+    {
+    }
+
+    void CameraCore::StreamListener::onNewFrame( _openni::VideoStream & )
+    {
+        CI_OPENNI_TRACE_THREAD( "OpenNI listener" );
+        camera.readStream( streamIndex );
+    }
+
+    void CameraCore::close()
+    {
+        stopCapture();
+        dispatcher.stop();
+
+        for ( auto &f : all ) {
+            f->stream.stop();
+            f->stream.destroy();
+        }
+        device.close();
+
+        // so setup() can open a device again from scratch
+        clearDerivedNodes();
+        all.clear();
+        allStreams.clear();
+        depthIndex = -1;
+        colorIndex = -1;
+    }
+
+    /**************************************************************************
+     * frame callbacks
+     */
+    CallbackId CameraCore::onDepthFrame( FrameCallback callback, int dispatchMode )
+    {
+        return addFrameCallback( _openni::SENSOR_DEPTH, callback, dispatchMode );
+    }
+
+    CallbackId CameraCore::onColorFrame( FrameCallback callback, int dispatchMode )
+    {
+        return addFrameCallback( _openni::SENSOR_COLOR, callback, dispatchMode );
+    }
+
+    CallbackId CameraCore::addFrameCallback( _openni::SensorType sensorType, FrameCallback callback, int dispatchMode )
+    {
+        if ( dispatchMode == DISPATCH_WORKER ) dispatcher.start();
+
+        std::lock_guard< std::mutex > lock( callbacksMutex );
+        FrameCallbackData data;
+        data.id = nextCallbackId++;
+        data.sensorType = sensorType;
+        data.dispatchMode = dispatchMode;
+        data.callback = std::make_shared< FrameCallbackSlot >( callback );
+
+        std::shared_ptr< std::vector< FrameCallbackData > > callbacks( new std::vector< FrameCallbackData >() );
+        if ( frameCallbacks ) *callbacks = *frameCallbacks;
+        callbacks->push_back( data );
+        frameCallbacks = callbacks;
+        return data.id;
+    }
+
+    void CameraCore::removeFrameCallback( CallbackId id )
+    {
+        std::shared_ptr< FrameCallbackSlot > removed;
+        {
+            std::lock_guard< std::mutex > lock( callbacksMutex );
+            if ( !frameCallbacks ) return;
+
+            std::shared_ptr< std::vector< FrameCallbackData > > callbacks( new std::vector< FrameCallbackData >() );
+            for ( auto &data : *frameCallbacks ) {
+                if ( data.id == id ) removed = data.callback;
+                else callbacks->push_back( data );
+            }
+            frameCallbacks = callbacks;
+        }
+        // waits for a call in progress on another thread
+        if ( removed ) removed->remove();
+    }
+
+    void CameraCore::dispatchFrame( const _openni::VideoFrameRef &frameRef )
+    {
+        std::shared_ptr< const std::vector< FrameCallbackData > > callbacks;
+        {
+            std::lock_guard< std::mutex > lock( callbacksMutex );
+            callbacks = frameCallbacks;
+        }
+        if ( !callbacks || callbacks->empty() ) return;
+
+        CI_OPENNI_TRACE_SCOPE( "dispatchFrame" );
+        FrameEvent event( frameRef );
+        _openni::SensorType sensorType = frameRef.getSensorType();
+        for ( auto &data : *callbacks ) {
+            if ( data.sensorType != sensorType ) continue;
+
+            if ( data.dispatchMode == DISPATCH_WORKER ) dispatcher.post( data.callback, event );
+            else data.callback->call( event );
+        }
+    }
+
+    /**************************************************************************
+     * getters
+     */
+    ImageSourceRef CameraCore::getDepthImage()
+    {
+        updateScaledDepth().updateImage< ImageSourceDepth >();
+        return scaledDepthFrameData.imageRef;
+    }
+
+    ImageSourceRef CameraCore::getRawDepthImage()
+    {
+        FrameData &frame = getFrameData( depthIndex );
+        frame.updateImage< ImageSourceRawDepth >();
+        return frame.imageRef;
+    }
+
+    ImageSourceRef CameraCore::getColorImage()
+    {
+        FrameData &frame = getFrameData( colorIndex );
+        frame.updateImage< ImageSourceColor >();
+        return frame.imageRef;
+    }
+
+    // Deallocator for channels and surfaces that wrap a frame.
+    static void releaseFrameRef( void *frameRef )
+    {
+        delete (_openni::VideoFrameRef *)frameRef;
+    }
+
+    Channel16u CameraCore::getDepthChannel16u()
+    {
+        FrameData &frame = getFrameData( depthIndex );
+        if ( frame.viewGeneration == frame.getGeneration() || !frame.frameRef.isValid() ) return frame.channel;
+
+        _openni::VideoFrameRef *frameRef = new _openni::VideoFrameRef( frame.frameRef );
+        frame.channel = Channel16u( frameRef->getWidth(), frameRef->getHeight(), frameRef->getStrideInBytes(), 1,
+                                    (uint16_t *)frameRef->getData() );
+        frame.channel.setDeallocator( releaseFrameRef, frameRef );
+        frame.viewGeneration = frame.getGeneration();
+        return frame.channel;
+    }
+
+    Surface8u CameraCore::getColorSurface()
+    {
+        FrameData &frame = getFrameData( colorIndex );
+        if ( frame.viewGeneration == frame.getGeneration() || !frame.frameRef.isValid() ) return frame.surface;
+
+        _openni::VideoFrameRef *frameRef = new _openni::VideoFrameRef( frame.frameRef );
+        frame.surface = Surface8u( (uint8_t *)frameRef->getData(), frameRef->getWidth(), frameRef->getHeight(),
+                                   frameRef->getStrideInBytes(), SurfaceChannelOrder::RGB );
+        frame.surface.setDeallocator( releaseFrameRef, frameRef );
+        frame.viewGeneration = frame.getGeneration();
+        return frame.surface;
+    }
+
+    /**************************************************************************
+     * depth filters
+     */
+    template < typename filter_t >
+    bool CameraCore::filterDepth( FilteredFrameData< filter_t > &frame, RollingSamples &samples )
+    {
+        FrameData &depth = getFrameData( depthIndex );
+
+        ScopedSample sample( samples );
+        int width = depth.frameRef.getWidth(), height = depth.frameRef.getHeight();
+        frame.filter.apply( (const uint16_t *)depth.frameRef.getData(), depth.frameRef.getStrideInBytes(), width, height, executor.get() );
+        if ( !frame.channel || frame.channel.getWidth() != width || frame.channel.getHeight() != height ) {
+            frame.size = Vec2i( width, height );
+            frame.channel = Channel16u( width, height, width * sizeof( uint16_t ), 1, frame.filter.getData() );
+        }
+        return true;
+    }
+
+    template < typename filter_t >
+    ImageSourceRef CameraCore::getFilteredImage( FilteredFrameData< filter_t > &frame )
+    {
+        if ( frame.isImageFresh() || !frame.isFresh() ) return frame.imageRef;
+
+        std::shared_ptr< ImageSourceRawDepth > image = frame.template reuseImage< ImageSourceRawDepth >();
+        if ( image ) {
+            image->setData( frame.filter.getData(), frame.size.x, frame.size.y );
+        }
+        else {
+            image = std::shared_ptr< ImageSourceRawDepth >( new ImageSourceRawDepth( frame.filter.getData(), frame.size.x, frame.size.y ) );
+            frame.keepImage( image );
+        }
+        frame.imageRef = image;
+        frame.imageGeneration = frame.getGeneration();
+        return frame.imageRef;
+    }
+
+    CameraCore::FilteredFrameData< TemporalDepthFilter > & CameraCore::updateFilteredDepth()
+    {
+        temporalDepthFrameData.update();
+        return temporalDepthFrameData;
+    }
+
+    CameraCore::FilteredFrameData< SpatialDepthFilter > & CameraCore::updateCleanDepth()
+    {
+        cleanDepthFrameData.update();
+        return cleanDepthFrameData;
+    }
+
+    ImageSourceRef CameraCore::getFilteredDepthImage()
+    {
+        return getFilteredImage( updateFilteredDepth() );
+    }
+
+    Channel16u CameraCore::getFilteredDepthChannel16u()
+    {
+        return updateFilteredDepth().channel;
+    }
+
+    ImageSourceRef CameraCore::getCleanDepthImage()
+    {
+        return getFilteredImage( updateCleanDepth() );
+    }
+
+    Channel16u CameraCore::getCleanDepthChannel16u()
+    {
+        return updateCleanDepth().channel;
+    }
+
+    /**************************************************************************
+     * point clouds
+     */
+    void CameraCore::setupPointCloudGenerator( FrameData &frame )
+    {
+        int width = frame.frameRef.getWidth(), height = frame.frameRef.getHeight();
+        if ( pointCloudGenerator.isSetup( width, height ) ) return;
+
+        // only on the first frame and on video mode changes, these go
+        // through the driver
+        pointCloudGenerator.setup( width, height,
+                                   frame.stream.getHorizontalFieldOfView(), frame.stream.getVerticalFieldOfView(),
+                                   getDepthMetadata().millimetersPerUnit );
+    }
+
+    DerivedNode & CameraCore::getPointCloudInput()
+    {
+        if ( pointCloudSource == DEPTH_FILTERED ) return temporalDepthFrameData;
+        if ( pointCloudSource == DEPTH_CLEAN ) return cleanDepthFrameData;
+        return getFrameData( depthIndex );
+    }
+
+    const uint16_t * CameraCore::getPointCloudDepth( int &strideInBytes )
+    {
+        if ( pointCloudSource == DEPTH_FILTERED ) {
+            strideInBytes = 0;
+            return temporalDepthFrameData.filter.getData();
+        }
+        if ( pointCloudSource == DEPTH_CLEAN ) {
+            strideInBytes = 0;
+            return cleanDepthFrameData.filter.getData();
+        }
+        FrameData &frame = getFrameData( depthIndex );
+        strideInBytes = frame.frameRef.getStrideInBytes();
+        return (const uint16_t *)frame.frameRef.getData();
+    }
+
+    void CameraCore::setPointCloudSource( int source )
+    {
+        if ( source == pointCloudSource ) return;
+
+        pointCloudSource = source;
+        if ( depthIndex < 0 ) return;
+
+        pointCloudNode.clearInputs();
+        pointCloudNode.addInput( getPointCloudInput() );
+        pointCloudSoANode.clearInputs();
+        pointCloudSoANode.addInput( getPointCloudInput() );
+    }
+
+    bool CameraCore::computePointCloud()
+    {
+        ScopedSample sample( pointCloudSamples );
+        CI_OPENNI_TRACE_SCOPE( "getPointCloud" );
+        setupPointCloudGenerator( getFrameData( depthIndex ) );
+        pointCloud.resize( pointCloudGenerator.getWidth() * pointCloudGenerator.getHeight() );
+        int strideInBytes;
+        const uint16_t *depth = getPointCloudDepth( strideInBytes );
+        pointCloudGenerator.convert( depth, strideInBytes, &pointCloud[0].x, executor.get() );
+        return true;
+    }
+
+    bool CameraCore::computePointCloudSoA()
+    {
+        ScopedSample sample( pointCloudSamples );
+        CI_OPENNI_TRACE_SCOPE( "getPointCloudSoA" );
+        setupPointCloudGenerator( getFrameData( depthIndex ) );
+        size_t count = pointCloudGenerator.getWidth() * pointCloudGenerator.getHeight();
+        pointCloudSoA.x.resize( count );
+        pointCloudSoA.y.resize( count );
+        pointCloudSoA.z.resize( count );
+        int strideInBytes;
+        const uint16_t *depth = getPointCloudDepth( strideInBytes );
+        pointCloudGenerator.convert( depth, strideInBytes, pointCloudSoA.x.data(), pointCloudSoA.y.data(), pointCloudSoA.z.data(),
+                                     executor.get() );
+        return true;
+    }
+
+    bool CameraCore::computeNormals()
+    {
+        CI_OPENNI_TRACE_SCOPE( "getNormals" );
+        normals.resize( pointCloud.size() );
+        PointCloudGenerator::computeNormals( &pointCloud[0].x, pointCloudGenerator.getWidth(), pointCloudGenerator.getHeight(),
+                                             &normals[0].x, executor.get() );
+        return true;
+    }
+
+    const std::vector< Vec3f > & CameraCore::getPointCloud()
+    {
+        pointCloudNode.update();
+        return pointCloud;
+    }
+
+    const CameraCore::PointCloudSoA & CameraCore::getPointCloudSoA()
+    {
+        pointCloudSoANode.update();
+        return pointCloudSoA;
+    }
+
+    const std::vector< Vec3f > & CameraCore::getNormals()
+    {
+        normalsNode.update();
+        return normals;
+    }
+
+    void CameraCore::setupRegistration( FrameData &depth, FrameData &color )
+    {
+        int depthWidth = depth.frameRef.getWidth(), depthHeight = depth.frameRef.getHeight();
+        int colorWidth = color.size.x, colorHeight = color.size.y;
+        if ( hasCustomRegistration ) {
+            if ( registration.getDepthWidth() == depthWidth && registration.getDepthHeight() == depthHeight ) return;
+            log() << "Depth registration doesn't match the depth video mode, generating it instead" << std::endl;
+            hasCustomRegistration = false;
+        }
+        if ( registration.isSetup( depthWidth, depthHeight, colorWidth, colorHeight ) ) return;
+
+        // one driver call per depth pixel and per depth value, only on the
+        // first frame and on video mode changes
+        _openni::VideoStream &depthStream = depth.stream, &colorStream = color.stream;
+        bool isMapped = registration.setup( depthWidth, depthHeight, colorWidth, colorHeight, (uint16_t)depth.maxPixelValue,
+            [&]( int x, int y, uint16_t z, int *colorX, int *colorY ) {
+                return _openni::CoordinateConverter::convertDepthToColor( depthStream, colorStream, x, y, z, colorX, colorY ) == _openni::STATUS_OK;
+            } );
+        if ( !isMapped ) {
+            log() << "Driver can't map depth to color, depth will only be rescaled" << std::endl;
+            registration.setupUnregistered( depthWidth, depthHeight, colorWidth, colorHeight, (uint16_t)depth.maxPixelValue );
+        }
+    }
+
+    bool CameraCore::computeRegisteredDepth()
+    {
+        FrameData &depth = getFrameData( depthIndex );
+        ScopedSample sample( registrationSamples );
+        CI_OPENNI_TRACE_SCOPE( "getRegisteredDepthChannel" );
+        setupRegistration( depth, getFrameData( colorIndex ) );
+        int width = registration.getColorWidth(), height = registration.getColorHeight();
+        if ( !registeredDepth || registeredDepth.getWidth() != width || registeredDepth.getHeight() != height ) {
+            registeredDepth = Channel16u( width, height );
+        }
+        registration.apply( (const uint16_t *)depth.frameRef.getData(), depth.frameRef.getStrideInBytes(), registeredDepth.getData() );
+        return true;
+    }
+
+    Channel16u CameraCore::getRegisteredDepthChannel()
+    {
+        registeredDepthNode.update();
+        return registeredDepth;
+    }
+
+    void CameraCore::setDepthRegistration( const DepthRegistration &_registration )
+    {
+        registration = _registration;
+        hasCustomRegistration = true;
+        registeredDepthNode.invalidate();
+    }
+
+    void CameraCore::setProcessingThreads( size_t count )
+    {
+        if ( count == 1 ) executor.reset();
+        else executor.reset( new RowExecutor( count ) );
+    }
+
+    CameraCore::DepthMetadata CameraCore::getDepthMetadata()
+    {
+        FrameData &frame = getFrameData( depthIndex );
+
+        DepthMetadata metadata;
+        metadata.maxValue = (uint16_t)frame.maxPixelValue;
+        metadata.millimetersPerUnit = frame.stream.getVideoMode().getPixelFormat() == _openni::PIXEL_FORMAT_DEPTH_100_UM ? 0.1f : 1.0f;
+        metadata.texScale = 65535.0f;
+        return metadata;
+    }
+
+    Vec2f CameraCore::getDepthFieldOfView()
+    {
+        _openni::VideoStream &stream = getFrameData( depthIndex ).stream;
+        return Vec2f( stream.getHorizontalFieldOfView(), stream.getVerticalFieldOfView() );
+    }
+
+    Vec2f CameraCore::getColorFieldOfView()
+    {
+        _openni::VideoStream &stream = getFrameData( colorIndex ).stream;
+        return Vec2f( stream.getHorizontalFieldOfView(), stream.getVerticalFieldOfView() );
+    }
+
+    CameraCore::FrameData & CameraCore::getFrameData( int index )
+    {
+        return *all.at( index );
+    }
+
+    CameraCore::DerivedFrameData & CameraCore::updateScaledDepth()
+    {
+        scaledDepthFrameData.checkVisualizer();
+        scaledDepthFrameData.update();
+        return scaledDepthFrameData;
+    }
+
+    CameraCore::Stats CameraCore::getStats() const
+    {
+        Stats stats;
+        memset( &stats, 0, sizeof( stats ) );
+        if ( depthIndex >= 0 ) all[depthIndex]->getStats( stats.depth );
+        if ( colorIndex >= 0 ) all[colorIndex]->getStats( stats.color );
+        stats.depthConversion = depthConversionSamples.getPercentiles();
+        stats.temporalFilter = temporalFilterSamples.getPercentiles();
+        stats.spatialFilter = spatialFilterSamples.getPercentiles();
+        stats.pointCloud = pointCloudSamples.getPercentiles();
+        stats.registration = registrationSamples.getPercentiles();
+        stats.textureUpload = textureUploadSamples.getPercentiles();
+        return stats;
+    }
+
+    /**************************************************************************
+     * FrameDataAbstract
+     */
+    CameraCore::FrameDataAbstract::FrameDataAbstract( Vec2i size ) :
+	size( size ),
+    imageGeneration( 0 ),
+    imagePoolNext( 0 )
+    {
+    }
+
+    template < typename image_t >
+    std::shared_ptr< image_t > CameraCore::FrameDataAbstract::reuseImage()
+    {
+        // let go of the current one, it's free if that was the last outside
+        // reference
+        imageRef.reset();
+        for ( int i = 0; i < IMAGE_POOL_SIZE; ++i ) {
+            if ( !imagePool[i].unique() ) continue;
+
+            std::shared_ptr< image_t > image = std::dynamic_pointer_cast< image_t >( imagePool[i] );
+            if ( image ) return image;
+        }
+        return std::shared_ptr< image_t >();
+    }
+
+    void CameraCore::FrameDataAbstract::keepImage( const ImageSourceRef &image )
+    {
+        for ( int i = 0; i < IMAGE_POOL_SIZE; ++i ) {
+            if ( !imagePool[i] ) {
+                imagePool[i] = image;
+                return;
+            }
+        }
+        // all taken, callers holding the one replaced keep it alive
+        imagePool[imagePoolNext] = image;
+        imagePoolNext = ( imagePoolNext + 1 ) % IMAGE_POOL_SIZE;
+    }
+
+    void CameraCore::FrameDataAbstract::initImage( Vec2i _size )
+    {
+        size = _size;
+        imageRef = ImageSourceRef( Surface8u(_size.x, _size.y, false) );
+    }
+
+    /**************************************************************************
+     * FrameData
+     */
+    CameraCore::FrameData::FrameData( _openni::VideoStream &stream, Vec2i size ) :
+    FrameDataAbstract( size ),
+    stream(stream),
+    maxPixelValue( stream.getMaxPixelValue() ),
+    frameReadTime( 0 ),
+    historyNext( 0 ),
+    framesRead( 0 ),
+    framesDropped( 0 ),
+    framesSkipped( 0 ),
+    framesConsumed( 0 ),
+    lastFrameIndex( 0 ),
+    lastReadTime( getHostTimeUs() ),
+    isStalled( false ),
+    stalls( 0 ),
+    shortestDelay( 0 ),
+    viewGeneration( 0 )
+    {
+        initImage( size );
+    }
+
+    void CameraCore::FrameData::getStats( StreamStats &stats ) const
+    {
+        stats.framesRead = framesRead;
+        stats.framesDropped = framesDropped;
+        stats.framesConsumed = framesConsumed;
+        stats.framesSkipped = framesSkipped;
+        stats.stalls = stalls;
+        stats.deviceToRead = deviceToRead.getPercentiles();
+        stats.readDuration = readDuration.getPercentiles();
+        stats.readToPublish = readToPublish.getPercentiles();
+        stats.readToTexture = readToTexture.getPercentiles();
+    }
+
+    template < typename image_t >
+    void CameraCore::FrameData::updateImage()
+    {
+        if ( isImageFresh() || !frameRef.isValid() ) return;
+
+        CI_OPENNI_TRACE_SCOPE( "updateImage" );
+        std::shared_ptr< image_t > image = reuseImage< image_t >();
+        if ( image ) {
+            image->setFrame( frameRef );
+        }
+        else {
+            image = std::shared_ptr< image_t >( new image_t( frameRef ) );
+            keepImage( image );
+        }
+        imageRef = image;
+        imageGeneration = getGeneration();
+    }
+
+	/**************************************************************************
+     * DerivedFrameData
+     */
+    CameraCore::DerivedFrameData::DerivedFrameData() :
+    FrameDataAbstract( Vec2i::zero() ),
+    original( NULL ),
+    convertedData( NULL ),
+    convertedCapacity( 0 ),
+    scale( 0 ),
+    visualizerVersion( 0 )
+    {
+    }
+
+    CameraCore::DerivedFrameData::~DerivedFrameData()
+    {
+        if ( convertedData != NULL ) delete []convertedData;
+    }
+
+    void CameraCore::DerivedFrameData::setOriginal( FrameData &_original )
+    {
+        if ( original == NULL ) {
+            initImage( _original.size );
+        }
+
+        int maxValue = _original.maxPixelValue;
+        scale = getDepthScale( maxValue );
+        visualizer.setMaxValue( (uint16_t)maxValue );
+
+        size = _original.size;
+        original = &_original;
+        clearInputs();
+        addInput( _original );
+    }
+
+    void CameraCore::DerivedFrameData::checkVisualizer()
+    {
+        // settings changed since the last conversion
+        if ( visualizer.getVersion() != visualizerVersion ) {
+            visualizerVersion = visualizer.getVersion();
+            invalidate();
+        }
+    }
+
+    bool CameraCore::DerivedFrameData::updateData()
+    {
+        CI_OPENNI_TRACE_SCOPE( "convertData" );
+        convertData( (const _openni::DepthPixel *)original->frameRef.getData(), &convertedData );
+        return true;
+    }
+
+    template < typename image_t >
+    void CameraCore::DerivedFrameData::updateImage()
+    {
+        if ( isImageFresh() || !isFresh() ) return;
+
+        CI_OPENNI_TRACE_SCOPE( "updateImage" );
+        if ( visualizer.getChannels() == 3 ) {
+            imageRef = updateDataImage< ImageSourceColor >( (_openni::RGB888Pixel *)convertedData );
+        }
+        else {
+            imageRef = updateDataImage< image_t >( convertedData );
+        }
+
+        imageGeneration = getGeneration();
+    }
+
+    template < typename image_t, typename pixel_t >
+    ImageSourceRef CameraCore::DerivedFrameData::updateDataImage( pixel_t *data )
+    {
+        std::shared_ptr< image_t > image = reuseImage< image_t >();
+        if ( image ) {
+            image->setData( data, size.x, size.y );
+        }
+        else {
+            image = std::shared_ptr< image_t >( new image_t( data, size.x, size.y ) );
+            keepImage( image );
+        }
+        return image;
+    }
+
+    void CameraCore::DerivedFrameData::convertData( const _openni::DepthPixel *originalData, uint8_t **_convertedData )
+    {
+        int _size = size.x * size.y;
+        // room for RGB, so switching colormaps never reallocates
+        size_t capacity = (size_t)_size * 3;
+        if ( *_convertedData == NULL || convertedCapacity < capacity ) {
+            delete []*_convertedData;
+            *_convertedData = new uint8_t[capacity];
+            convertedCapacity = capacity;
+        }
+
+        if ( visualizer.isLinear() ) {
+            convertDepthTo8u( originalData, *_convertedData, _size, scale );
+        }
+        else {
+            visualizer.apply( originalData, *_convertedData, _size );
+        }
+    }
+
+} }
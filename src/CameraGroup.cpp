@@ -0,0 +1,40 @@
+#include "CinderOpenNI.h"
+#include "CinderOpenNI/CameraGroup.h"
+
+namespace cinder { namespace openni {
+    void CameraGroup::setup( int enableSensors, int captureMode )
+    {
+        std::vector< std::string > uris;
+        for ( auto &device : Camera::enumerateDevices() ) uris.push_back( device.getUri() );
+        setup( uris, enableSensors, captureMode );
+    }
+
+    void CameraGroup::setup( const std::vector< std::string > &uris, int enableSensors, int captureMode )
+    {
+        close();
+        for ( auto &uri : uris ) {
+            CameraRef camera( new Camera() );
+            cameras.push_back( camera );
+            try {
+                camera->setup( uri, enableSensors, captureMode );
+            }
+            catch ( ... ) {
+                // stop the capture threads of the ones already open, and
+                // whatever the failed one got to open
+                close();
+                throw;
+            }
+        }
+    }
+
+    void CameraGroup::update()
+    {
+        for ( auto &camera : cameras ) camera->update();
+    }
+
+    void CameraGroup::close()
+    {
+        for ( auto &camera : cameras ) camera->close();
+        cameras.clear();
+    }
+} }
@@ -0,0 +1,170 @@
+#include "CinderOpenNI/DepthConversion.h"
+
+#if defined( _M_X64 ) || defined( _M_IX86 ) || defined( __x86_64__ ) || defined( __i386__ )
+#   define CI_OPENNI_X86
+#   include <emmintrin.h>
+#   if defined( __GNUC__ ) || ( defined( _MSC_VER ) && _MSC_VER >= 1800 )
+#       define CI_OPENNI_AVX2
+#       include <immintrin.h>
+#   endif
+#   if defined( _MSC_VER )
+#       include <intrin.h>
+#   else
+#       include <cpuid.h>
+#   endif
+#endif
+
+#if defined( __GNUC__ )
+#   define CI_OPENNI_TARGET( isa ) __attribute__(( target( isa ) ))
+#else
+#   define CI_OPENNI_TARGET( isa )
+#endif
+
+namespace cinder { namespace openni {
+    static int detectSimdLevel()
+    {
+#if defined( CI_OPENNI_X86 )
+        int level = SIMD_NONE;
+#   if defined( _MSC_VER )
+        int info[4];
+        __cpuid( info, 0 );
+        int maxLeaf = info[0];
+        __cpuid( info, 1 );
+        if ( info[3] & ( 1 << 26 ) ) level = SIMD_SSE2;
+        bool osSavesYmm = ( info[2] & ( 1 << 27 ) ) && ( _xgetbv( 0 ) & 0x6 ) == 0x6;
+        if ( maxLeaf >= 7 && osSavesYmm ) {
+            __cpuidex( info, 7, 0 );
+            if ( info[1] & ( 1 << 5 ) ) level = SIMD_AVX2;
+        }
+#   else
+        unsigned int a, b, c, d;
+        if ( !__get_cpuid( 1, &a, &b, &c, &d ) ) return SIMD_NONE;
+        if ( d & ( 1 << 26 ) ) level = SIMD_SSE2;
+        bool osSavesYmm = false;
+        if ( c & ( 1 << 27 ) ) {
+            unsigned int xcr0Lo, xcr0Hi;
+            __asm__( "xgetbv" : "=a"( xcr0Lo ), "=d"( xcr0Hi ) : "c"( 0 ) );
+            osSavesYmm = ( xcr0Lo & 0x6 ) == 0x6;
+        }
+        if ( osSavesYmm && __get_cpuid_max( 0, 0 ) >= 7 ) {
+            __cpuid_count( 7, 0, a, b, c, d );
+            if ( b & ( 1 << 5 ) ) level = SIMD_AVX2;
+        }
+#   endif
+#   if !defined( CI_OPENNI_AVX2 )
+        if ( level > SIMD_SSE2 ) level = SIMD_SSE2;
+#   endif
+        return level;
+#else
+        return SIMD_NONE;
+#endif
+    }
+
+    int getSimdLevel()
+    {
+        static const int level = detectSimdLevel();
+        return level;
+    }
+
+    uint32_t getDepthScale( int maxValue )
+    {
+        if ( maxValue <= 0 ) return 0;
+        return ( 255u << 16 ) / (uint32_t)maxValue;
+    }
+
+    void convertDepthTo8u( const uint16_t *src, uint8_t *dst, size_t count, uint32_t scale )
+    {
+        switch ( getSimdLevel() ) {
+            case SIMD_AVX2: convertDepthTo8uAvx2( src, dst, count, scale ); break;
+            case SIMD_SSE2: convertDepthTo8uSse2( src, dst, count, scale ); break;
+            default: convertDepthTo8uScalar( src, dst, count, scale ); break;
+        }
+    }
+
+    void convertDepthTo8uScalar( const uint16_t *src, uint8_t *dst, size_t count, uint32_t scale )
+    {
+        // clamped as in the SIMD kernels, keeps the product in 32 bits
+        uint32_t srcLimit = scale >> 16 ? 255 : 0xFFFF;
+        for ( size_t i = 0; i < count; ++i ) {
+            uint32_t value = ( ( src[i] < srcLimit ? src[i] : srcLimit ) * scale ) >> 16;
+            dst[i] = (uint8_t)( value > 255 ? 255 : value );
+        }
+    }
+
+#if defined( CI_OPENNI_X86 )
+    // The kernels split scale into its integer and fraction halves, so
+    // src * scale >> 16 = src * whole + mulhi( src, fraction ) in 16 bits.
+    // With a whole part (maxValue < 255), any src >= 255 ends up at 255, so
+    // src is clamped there first to keep src * whole from overflowing. The
+    // sum is clamped to 255 before packing: packus saturates signed, and
+    // would turn sums of 32768 and up into 0. SSE2 has no unsigned 16 bit
+    // min, a - subs( a, b ) is one.
+    CI_OPENNI_TARGET( "sse2" )
+    static inline __m128i scaleDepthSse2( __m128i value, __m128i srcLimit, __m128i whole, __m128i fraction, __m128i max )
+    {
+        value = _mm_sub_epi16( value, _mm_subs_epu16( value, srcLimit ) );
+        value = _mm_adds_epu16( _mm_mullo_epi16( value, whole ), _mm_mulhi_epu16( value, fraction ) );
+        return _mm_sub_epi16( value, _mm_subs_epu16( value, max ) );
+    }
+
+    CI_OPENNI_TARGET( "sse2" )
+    void convertDepthTo8uSse2( const uint16_t *src, uint8_t *dst, size_t count, uint32_t scale )
+    {
+        const __m128i srcLimit = _mm_set1_epi16( (short)( scale >> 16 ? 255 : 0xFFFF ) );
+        const __m128i whole = _mm_set1_epi16( (short)( scale >> 16 ) );
+        const __m128i fraction = _mm_set1_epi16( (short)( scale & 0xFFFF ) );
+        const __m128i max = _mm_set1_epi16( 255 );
+        size_t i = 0;
+
+        for ( ; i + 16 <= count; i += 16 ) {
+            __m128i lo = _mm_loadu_si128( (const __m128i *)( src + i ) );
+            __m128i hi = _mm_loadu_si128( (const __m128i *)( src + i + 8 ) );
+            lo = scaleDepthSse2( lo, srcLimit, whole, fraction, max );
+            hi = scaleDepthSse2( hi, srcLimit, whole, fraction, max );
+            _mm_storeu_si128( (__m128i *)( dst + i ), _mm_packus_epi16( lo, hi ) );
+        }
+
+        convertDepthTo8uScalar( src + i, dst + i, count - i, scale );
+    }
+#else
+    void convertDepthTo8uSse2( const uint16_t *src, uint8_t *dst, size_t count, uint32_t scale )
+    {
+        convertDepthTo8uScalar( src, dst, count, scale );
+    }
+#endif
+
+#if defined( CI_OPENNI_AVX2 )
+    CI_OPENNI_TARGET( "avx2" )
+    void convertDepthTo8uAvx2( const uint16_t *src, uint8_t *dst, size_t count, uint32_t scale )
+    {
+        const __m256i srcLimit = _mm256_set1_epi16( (short)( scale >> 16 ? 255 : 0xFFFF ) );
+        const __m256i whole = _mm256_set1_epi16( (short)( scale >> 16 ) );
+        const __m256i fraction = _mm256_set1_epi16( (short)( scale & 0xFFFF ) );
+        const __m256i max = _mm256_set1_epi16( 255 );
+        size_t i = 0;
+
+        // as scaleDepthSse2()
+        for ( ; i + 32 <= count; i += 32 ) {
+            __m256i lo = _mm256_loadu_si256( (const __m256i *)( src + i ) );
+            __m256i hi = _mm256_loadu_si256( (const __m256i *)( src + i + 16 ) );
+            lo = _mm256_min_epu16( lo, srcLimit );
+            hi = _mm256_min_epu16( hi, srcLimit );
+            lo = _mm256_adds_epu16( _mm256_mullo_epi16( lo, whole ), _mm256_mulhi_epu16( lo, fraction ) );
+            hi = _mm256_adds_epu16( _mm256_mullo_epi16( hi, whole ), _mm256_mulhi_epu16( hi, fraction ) );
+            lo = _mm256_min_epu16( lo, max );
+            hi = _mm256_min_epu16( hi, max );
+            // packus works per 128 bit lane, put the quadwords back in order
+            __m256i packed = _mm256_packus_epi16( lo, hi );
+            packed = _mm256_permute4x64_epi64( packed, 0xD8 );
+            _mm256_storeu_si256( (__m256i *)( dst + i ), packed );
+        }
+
+        convertDepthTo8uSse2( src + i, dst + i, count - i, scale );
+    }
+#else
+    void convertDepthTo8uAvx2( const uint16_t *src, uint8_t *dst, size_t count, uint32_t scale )
+    {
+        convertDepthTo8uSse2( src, dst, count, scale );
+    }
+#endif
+} }
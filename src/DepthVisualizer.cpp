@@ -0,0 +1,178 @@
+#include "CinderOpenNI/DepthVisualizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace cinder { namespace openni {
+    static const size_t TABLE_SIZE = 0x10000;
+
+    static uint8_t toByte( float value )
+    {
+        return (uint8_t)( std::min( std::max( value, 0.0f ), 1.0f ) * 255.0f + 0.5f );
+    }
+
+    // Polynomial fit of Google's Turbo colormap.
+    static void turbo( float t, uint8_t *rgb )
+    {
+        float t2 = t * t, t3 = t2 * t, t4 = t3 * t, t5 = t4 * t;
+        rgb[0] = toByte( 0.13572138f + 4.61539260f * t - 42.66032258f * t2 + 132.13108234f * t3 - 152.94239396f * t4 + 59.28637943f * t5 );
+        rgb[1] = toByte( 0.09140261f + 2.19418839f * t + 4.84296658f * t2 - 14.18503333f * t3 + 4.27729857f * t4 + 2.82956604f * t5 );
+        rgb[2] = toByte( 0.10667330f + 12.64194608f * t - 60.58204836f * t2 + 110.36276771f * t3 - 89.90310912f * t4 + 27.34824973f * t5 );
+    }
+
+    static void jet( float t, uint8_t *rgb )
+    {
+        rgb[0] = toByte( 1.5f - std::fabs( 4.0f * t - 3.0f ) );
+        rgb[1] = toByte( 1.5f - std::fabs( 4.0f * t - 2.0f ) );
+        rgb[2] = toByte( 1.5f - std::fabs( 4.0f * t - 1.0f ) );
+    }
+
+    DepthVisualizer::DepthVisualizer() :
+    nearValue( 0 ),
+    farValue( 0 ),
+    maxValue( 0xFFFF ),
+    gamma( 1.0f ),
+    colormap( COLORMAP_GRAYSCALE ),
+    version( 0 ),
+    isTableDirty( true )
+    {
+    }
+
+    void DepthVisualizer::setRange( uint16_t nearDepth, uint16_t farDepth )
+    {
+        if ( nearDepth == nearValue && farDepth == farValue ) return;
+        nearValue = nearDepth;
+        farValue = farDepth;
+        isTableDirty = true;
+        ++version;
+    }
+
+    void DepthVisualizer::setGamma( float _gamma )
+    {
+        if ( _gamma == gamma ) return;
+        gamma = _gamma;
+        isTableDirty = true;
+        ++version;
+    }
+
+    void DepthVisualizer::setColormap( int _colormap )
+    {
+        if ( _colormap == colormap ) return;
+        colormap = _colormap;
+        isTableDirty = true;
+        ++version;
+    }
+
+    void DepthVisualizer::setMaxValue( uint16_t _maxValue )
+    {
+        if ( _maxValue == maxValue ) return;
+        maxValue = _maxValue;
+        isTableDirty = true;
+        ++version;
+    }
+
+    int DepthVisualizer::getChannels() const
+    {
+        return colormap == COLORMAP_TURBO || colormap == COLORMAP_JET ? 3 : 1;
+    }
+
+    bool DepthVisualizer::isLinear() const
+    {
+        return colormap == COLORMAP_GRAYSCALE && nearValue == 0 && getFar() == maxValue && gamma == 1.0f;
+    }
+
+    void DepthVisualizer::apply( const uint16_t *src, uint8_t *dst, size_t count )
+    {
+        if ( colormap == COLORMAP_HISTOGRAM ) buildHistogramTable( src, count );
+        else if ( isTableDirty ) buildTable();
+
+        // unrolled so the table reads of neighbouring pixels overlap, the
+        // loop is bound by their latency
+        const uint8_t *lut = table.data();
+        size_t i = 0;
+        if ( getChannels() == 1 ) {
+            for ( ; i + 8 <= count; i += 8 ) {
+                uint8_t a = lut[src[i]], b = lut[src[i + 1]], c = lut[src[i + 2]], d = lut[src[i + 3]];
+                uint8_t e = lut[src[i + 4]], f = lut[src[i + 5]], g = lut[src[i + 6]], h = lut[src[i + 7]];
+                dst[i] = a; dst[i + 1] = b; dst[i + 2] = c; dst[i + 3] = d;
+                dst[i + 4] = e; dst[i + 5] = f; dst[i + 6] = g; dst[i + 7] = h;
+            }
+            for ( ; i < count; ++i ) dst[i] = lut[src[i]];
+        }
+        else {
+            // RGB entries are padded to 4 bytes, so a pixel is one 32 bit
+            // read and write; the padding byte written past each pixel is
+            // overwritten by the next one
+            for ( ; i + 5 <= count; i += 4, dst += 12 ) {
+                uint32_t a, b, c, d;
+                std::memcpy( &a, lut + src[i] * 4, 4 );
+                std::memcpy( &b, lut + src[i + 1] * 4, 4 );
+                std::memcpy( &c, lut + src[i + 2] * 4, 4 );
+                std::memcpy( &d, lut + src[i + 3] * 4, 4 );
+                std::memcpy( dst, &a, 4 );
+                std::memcpy( dst + 3, &b, 4 );
+                std::memcpy( dst + 6, &c, 4 );
+                std::memcpy( dst + 9, &d, 4 );
+            }
+            for ( ; i < count; ++i, dst += 3 ) std::memcpy( dst, lut + src[i] * 4, 3 );
+        }
+    }
+
+    void DepthVisualizer::writeEntry( uint16_t depth, float t )
+    {
+        if ( gamma != 1.0f ) t = std::pow( t, gamma );
+
+        switch ( colormap ) {
+            case COLORMAP_TURBO: turbo( t, &table[depth * 4] ); break;
+            case COLORMAP_JET: jet( t, &table[depth * 4] ); break;
+            default: table[depth] = toByte( t ); break;
+        }
+    }
+
+    void DepthVisualizer::buildTable()
+    {
+        // RGB entries padded to 4 bytes, see apply()
+        table.assign( TABLE_SIZE * ( getChannels() == 1 ? 1 : 4 ), 0 );
+
+        uint16_t nearDepth = std::max< uint16_t >( nearValue, 1 );
+        uint16_t farDepth = getFar();
+        float range = farDepth > nearDepth ? (float)( farDepth - nearDepth ) : 1.0f;
+
+        for ( uint32_t depth = nearDepth; depth <= farDepth; ++depth ) {
+            writeEntry( (uint16_t)depth, ( depth - nearDepth ) / range );
+        }
+
+        isTableDirty = false;
+    }
+
+    void DepthVisualizer::buildHistogramTable( const uint16_t *src, size_t count )
+    {
+        uint16_t nearDepth = std::max< uint16_t >( nearValue, 1 );
+        uint16_t farDepth = getFar();
+        if ( farDepth < nearDepth ) farDepth = nearDepth;
+        size_t bins = farDepth - nearDepth + 1;
+
+        if ( table.size() != TABLE_SIZE ) table.assign( TABLE_SIZE, 0 );
+        else if ( isTableDirty ) std::memset( table.data(), 0, TABLE_SIZE );
+        // one extra bin collects everything outside the window, which keeps
+        // the counting loop free of branches
+        histogram.assign( bins + 1, 0 );
+
+        uint32_t *counts = histogram.data();
+        for ( size_t i = 0; i < count; ++i ) {
+            uint32_t bin = (uint32_t)src[i] - nearDepth;
+            ++counts[bin < bins ? bin : bins];
+        }
+
+        uint32_t total = (uint32_t)count - histogram[bins];
+        if ( total == 0 ) total = 1;
+        uint32_t cumulative = 0;
+        for ( size_t bin = 0; bin < bins; ++bin ) {
+            cumulative += histogram[bin];
+            writeEntry( (uint16_t)( nearDepth + bin ), 1.0f - cumulative / (float)total );
+        }
+
+        isTableDirty = false;
+    }
+} }
@@ -0,0 +1,73 @@
+#include "CinderOpenNI/DerivedNode.h"
+
+#include <algorithm>
+
+namespace cinder { namespace openni {
+    DerivedNode::DerivedNode( const ComputeFn &compute ) :
+    compute( compute ),
+    fresh( false ),
+    generation( 0 )
+    {
+    }
+
+    DerivedNode::~DerivedNode()
+    {
+        clearInputs();
+        for ( size_t i = 0; i < dependents.size(); ++i ) {
+            std::vector< DerivedNode * > &dependentInputs = dependents[i]->inputs;
+            dependentInputs.erase( std::remove( dependentInputs.begin(), dependentInputs.end(), this ), dependentInputs.end() );
+            dependents[i]->invalidate();
+        }
+    }
+
+    void DerivedNode::addInput( DerivedNode &input )
+    {
+        inputs.push_back( &input );
+        input.dependents.push_back( this );
+        invalidate();
+    }
+
+    void DerivedNode::clearInputs()
+    {
+        for ( size_t i = 0; i < inputs.size(); ++i ) inputs[i]->removeDependent( this );
+        inputs.clear();
+        invalidate();
+    }
+
+    void DerivedNode::removeDependent( DerivedNode *dependent )
+    {
+        dependents.erase( std::remove( dependents.begin(), dependents.end(), dependent ), dependents.end() );
+    }
+
+    void DerivedNode::invalidate()
+    {
+        // nodes only become fresh after their inputs, so below a stale node
+        // everything is stale already
+        if ( !fresh ) return;
+
+        fresh = false;
+        for ( size_t i = 0; i < dependents.size(); ++i ) dependents[i]->invalidate();
+    }
+
+    void DerivedNode::touch()
+    {
+        ++generation;
+        fresh = true;
+        for ( size_t i = 0; i < dependents.size(); ++i ) dependents[i]->invalidate();
+    }
+
+    bool DerivedNode::update()
+    {
+        if ( fresh ) return true;
+        if ( !compute ) return false;
+
+        for ( size_t i = 0; i < inputs.size(); ++i ) {
+            if ( !inputs[i]->update() ) return false;
+        }
+        if ( !compute() ) return false;
+
+        ++generation;
+        fresh = true;
+        return true;
+    }
+}}
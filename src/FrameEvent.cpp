@@ -0,0 +1,83 @@
+#include "CinderOpenNI/CameraCore.h"
+#include "CinderOpenNI/FrameEvent.h"
+#include "CinderOpenNI/Trace.h"
+
+namespace cinder { namespace openni {
+    FrameDispatcher::FrameDispatcher( size_t capacity ) :
+    jobs( capacity ),
+    first( 0 ),
+    count( 0 ),
+    isRunning( false )
+    {
+    }
+
+    FrameDispatcher::~FrameDispatcher()
+    {
+        stop();
+    }
+
+    void FrameDispatcher::start()
+    {
+        std::lock_guard< std::mutex > lock( mutex );
+        if ( isRunning ) return;
+
+        isRunning = true;
+        thread = std::thread( &FrameDispatcher::run, this );
+    }
+
+    void FrameDispatcher::stop()
+    {
+        {
+            std::lock_guard< std::mutex > lock( mutex );
+            if ( !isRunning ) return;
+            isRunning = false;
+        }
+        condition.notify_one();
+        if ( thread.joinable() ) thread.join();
+
+        for ( auto &job : jobs ) job = Job();
+        first = count = 0;
+    }
+
+    void FrameDispatcher::post( const std::shared_ptr< FrameCallbackSlot > &callback, const FrameEvent &event )
+    {
+        {
+            std::lock_guard< std::mutex > lock( mutex );
+            if ( !isRunning ) return;
+
+            if ( count == jobs.size() ) {
+                first = ( first + 1 ) % jobs.size();
+                --count;
+            }
+            Job &job = jobs[( first + count ) % jobs.size()];
+            job.callback = callback;
+            job.event = event;
+            ++count;
+        }
+        condition.notify_one();
+    }
+
+    void FrameDispatcher::run()
+    {
+        Job job;
+
+        while ( true ) {
+            {
+                std::unique_lock< std::mutex > lock( mutex );
+                while ( isRunning && count == 0 ) condition.wait( lock );
+                if ( !isRunning ) return;
+
+                std::swap( job, jobs[first] );
+                first = ( first + 1 ) % jobs.size();
+                --count;
+            }
+
+            CI_OPENNI_TRACE_THREAD( "OpenNI frame callbacks" );
+            {
+                CI_OPENNI_TRACE_SCOPE( "frame callback" );
+                job.callback->call( job.event );
+            }
+            job = Job();
+        }
+    }
+} }
@@ -0,0 +1,85 @@
+#include "CinderOpenNI/Parallel.h"
+
+namespace cinder { namespace openni {
+    RowExecutor::RowExecutor( size_t threadCount ) :
+    generation( 0 ),
+    busyWorkers( 0 ),
+    isStopping( false ),
+    task( NULL ),
+    rows( 0 ),
+    tileRows( 1 ),
+    nextRow( 0 )
+    {
+        if ( threadCount == 0 ) threadCount = std::thread::hardware_concurrency();
+        for ( size_t i = 1; i < threadCount; ++i ) {
+            workers.push_back( std::thread( &RowExecutor::workerLoop, this ) );
+        }
+    }
+
+    RowExecutor::~RowExecutor()
+    {
+        {
+            std::lock_guard< std::mutex > lock( mutex );
+            isStopping = true;
+        }
+        startCondition.notify_all();
+        for ( auto &worker : workers ) worker.join();
+    }
+
+    void RowExecutor::run( int _rows, const RowTask &_task, int _tileRows )
+    {
+        if ( workers.empty() || _rows <= _tileRows ) {
+            _task( 0, _rows );
+            return;
+        }
+
+        {
+            std::lock_guard< std::mutex > lock( mutex );
+            task = &_task;
+            rows = _rows;
+            tileRows = _tileRows > 0 ? _tileRows : 1;
+            nextRow = 0;
+            busyWorkers = workers.size();
+            ++generation;
+        }
+        startCondition.notify_all();
+
+        runTiles();
+
+        std::unique_lock< std::mutex > lock( mutex );
+        while ( busyWorkers > 0 ) doneCondition.wait( lock );
+        task = NULL;
+    }
+
+    void RowExecutor::runTiles()
+    {
+        while ( true ) {
+            int begin = nextRow.fetch_add( tileRows );
+            if ( begin >= rows ) return;
+            int end = begin + tileRows < rows ? begin + tileRows : rows;
+            ( *task )( begin, end );
+        }
+    }
+
+    void RowExecutor::workerLoop()
+    {
+        uint64_t seenGeneration = 0;
+
+        while ( true ) {
+            {
+                std::unique_lock< std::mutex > lock( mutex );
+                while ( !isStopping && generation == seenGeneration ) startCondition.wait( lock );
+                if ( isStopping ) return;
+                seenGeneration = generation;
+            }
+
+            runTiles();
+
+            {
+                std::lock_guard< std::mutex > lock( mutex );
+                --busyWorkers;
+            }
+            doneCondition.notify_one();
+        }
+    }
+} }
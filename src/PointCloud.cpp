@@ -0,0 +1,242 @@
+#include "CinderOpenNI/PointCloud.h"
+#include "CinderOpenNI/DepthConversion.h"
+#include "CinderOpenNI/Parallel.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined( _M_X64 ) || defined( _M_IX86 ) || defined( __x86_64__ ) || defined( __i386__ )
+#   define CI_OPENNI_X86
+#   include <emmintrin.h>
+#   if defined( __GNUC__ ) || ( defined( _MSC_VER ) && _MSC_VER >= 1800 )
+#       define CI_OPENNI_AVX2
+#       include <immintrin.h>
+#   endif
+#endif
+
+#if defined( __GNUC__ )
+#   define CI_OPENNI_TARGET( isa ) __attribute__(( target( isa ) ))
+#else
+#   define CI_OPENNI_TARGET( isa )
+#endif
+
+namespace cinder { namespace openni {
+#if defined( CI_OPENNI_X86 )
+    // x, y, z for four points to twelve interleaved floats
+    CI_OPENNI_TARGET( "sse2" )
+    static inline void storeInterleaved( float *xyz, __m128 x, __m128 y, __m128 z )
+    {
+        __m128 xy01 = _mm_unpacklo_ps( x, y );
+        __m128 xy23 = _mm_unpackhi_ps( x, y );
+        __m128 z0xy1 = _mm_shuffle_ps( z, xy01, _MM_SHUFFLE( 2, 2, 0, 0 ) );
+        __m128 y1z1 = _mm_shuffle_ps( xy01, z, _MM_SHUFFLE( 1, 1, 3, 3 ) );
+        __m128 z2xy2 = _mm_shuffle_ps( z, xy23, _MM_SHUFFLE( 3, 2, 2, 2 ) );
+        __m128 y3z3 = _mm_shuffle_ps( xy23, z, _MM_SHUFFLE( 3, 3, 3, 3 ) );
+        _mm_storeu_ps( xyz, _mm_shuffle_ps( xy01, z0xy1, _MM_SHUFFLE( 2, 0, 1, 0 ) ) );
+        _mm_storeu_ps( xyz + 4, _mm_shuffle_ps( y1z1, xy23, _MM_SHUFFLE( 1, 0, 2, 0 ) ) );
+        _mm_storeu_ps( xyz + 8, _mm_shuffle_ps( z2xy2, y3z3, _MM_SHUFFLE( 2, 0, 2, 0 ) ) );
+    }
+
+    CI_OPENNI_TARGET( "sse2" )
+    static int convertRowSse2( const uint16_t *depth, const float *raysX, float rayY, float scale, int width, float *xyz )
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128 scales = _mm_set1_ps( scale );
+        const __m128 rayYs = _mm_set1_ps( rayY );
+        int x = 0;
+
+        for ( ; x + 8 <= width; x += 8 ) {
+            __m128i d = _mm_loadu_si128( (const __m128i *)( depth + x ) );
+            __m128 z0 = _mm_mul_ps( _mm_cvtepi32_ps( _mm_unpacklo_epi16( d, zero ) ), scales );
+            __m128 z1 = _mm_mul_ps( _mm_cvtepi32_ps( _mm_unpackhi_epi16( d, zero ) ), scales );
+            storeInterleaved( xyz + x * 3, _mm_mul_ps( _mm_loadu_ps( raysX + x ), z0 ), _mm_mul_ps( rayYs, z0 ), z0 );
+            storeInterleaved( xyz + x * 3 + 12, _mm_mul_ps( _mm_loadu_ps( raysX + x + 4 ), z1 ), _mm_mul_ps( rayYs, z1 ), z1 );
+        }
+        return x;
+    }
+
+    CI_OPENNI_TARGET( "sse2" )
+    static int convertRowSse2( const uint16_t *depth, const float *raysX, float rayY, float scale, int width, float *xs, float *ys, float *zs )
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128 scales = _mm_set1_ps( scale );
+        const __m128 rayYs = _mm_set1_ps( rayY );
+        int x = 0;
+
+        for ( ; x + 8 <= width; x += 8 ) {
+            __m128i d = _mm_loadu_si128( (const __m128i *)( depth + x ) );
+            __m128 z0 = _mm_mul_ps( _mm_cvtepi32_ps( _mm_unpacklo_epi16( d, zero ) ), scales );
+            __m128 z1 = _mm_mul_ps( _mm_cvtepi32_ps( _mm_unpackhi_epi16( d, zero ) ), scales );
+            _mm_storeu_ps( xs + x, _mm_mul_ps( _mm_loadu_ps( raysX + x ), z0 ) );
+            _mm_storeu_ps( xs + x + 4, _mm_mul_ps( _mm_loadu_ps( raysX + x + 4 ), z1 ) );
+            _mm_storeu_ps( ys + x, _mm_mul_ps( rayYs, z0 ) );
+            _mm_storeu_ps( ys + x + 4, _mm_mul_ps( rayYs, z1 ) );
+            _mm_storeu_ps( zs + x, z0 );
+            _mm_storeu_ps( zs + x + 4, z1 );
+        }
+        return x;
+    }
+#endif
+
+#if defined( CI_OPENNI_AVX2 )
+    CI_OPENNI_TARGET( "avx2" )
+    static int convertRowAvx2( const uint16_t *depth, const float *raysX, float rayY, float scale, int width, float *xs, float *ys, float *zs )
+    {
+        const __m256 scales = _mm256_set1_ps( scale );
+        const __m256 rayYs = _mm256_set1_ps( rayY );
+        int x = 0;
+
+        for ( ; x + 8 <= width; x += 8 ) {
+            __m128i d = _mm_loadu_si128( (const __m128i *)( depth + x ) );
+            __m256 z = _mm256_mul_ps( _mm256_cvtepi32_ps( _mm256_cvtepu16_epi32( d ) ), scales );
+            _mm256_storeu_ps( xs + x, _mm256_mul_ps( _mm256_loadu_ps( raysX + x ), z ) );
+            _mm256_storeu_ps( ys + x, _mm256_mul_ps( rayYs, z ) );
+            _mm256_storeu_ps( zs + x, z );
+        }
+        return x;
+    }
+#endif
+
+    PointCloudGenerator::PointCloudGenerator() :
+    width( 0 ),
+    height( 0 ),
+    millimetersPerUnit( 1.0f )
+    {
+    }
+
+    void PointCloudGenerator::setup( int _width, int _height, float horizontalFov, float verticalFov, float _millimetersPerUnit )
+    {
+        width = _width;
+        height = _height;
+        millimetersPerUnit = _millimetersPerUnit;
+
+        float xzFactor = std::tan( horizontalFov / 2.0f ) * 2.0f;
+        float yzFactor = std::tan( verticalFov / 2.0f ) * 2.0f;
+
+        raysX.resize( width );
+        for ( int x = 0; x < width; ++x ) raysX[x] = ( (float)x / width - 0.5f ) * xzFactor;
+        raysY.resize( height );
+        for ( int y = 0; y < height; ++y ) raysY[y] = ( 0.5f - (float)y / height ) * yzFactor;
+    }
+
+    void PointCloudGenerator::convertRowScalar( const uint16_t *depth, int row, float *xyz ) const
+    {
+        float rayY = raysY[row];
+        for ( int x = 0; x < width; ++x, xyz += 3 ) {
+            float z = depth[x] * millimetersPerUnit;
+            xyz[0] = raysX[x] * z;
+            xyz[1] = rayY * z;
+            xyz[2] = z;
+        }
+    }
+
+    void PointCloudGenerator::convertRowScalar( const uint16_t *depth, int row, float *xs, float *ys, float *zs ) const
+    {
+        float rayY = raysY[row];
+        for ( int x = 0; x < width; ++x ) {
+            float z = depth[x] * millimetersPerUnit;
+            xs[x] = raysX[x] * z;
+            ys[x] = rayY * z;
+            zs[x] = z;
+        }
+    }
+
+    void PointCloudGenerator::convertRow( const uint16_t *depth, int row, float *xyz ) const
+    {
+        int x = 0;
+#if defined( CI_OPENNI_X86 )
+        if ( getSimdLevel() >= SIMD_SSE2 ) x = convertRowSse2( depth, raysX.data(), raysY[row], millimetersPerUnit, width, xyz );
+#endif
+        float rayY = raysY[row];
+        for ( ; x < width; ++x ) {
+            float z = depth[x] * millimetersPerUnit;
+            xyz[x * 3] = raysX[x] * z;
+            xyz[x * 3 + 1] = rayY * z;
+            xyz[x * 3 + 2] = z;
+        }
+    }
+
+    void PointCloudGenerator::convertRow( const uint16_t *depth, int row, float *xs, float *ys, float *zs ) const
+    {
+        int x = 0;
+#if defined( CI_OPENNI_AVX2 )
+        if ( getSimdLevel() >= SIMD_AVX2 ) x = convertRowAvx2( depth, raysX.data(), raysY[row], millimetersPerUnit, width, xs, ys, zs );
+        else
+#endif
+#if defined( CI_OPENNI_X86 )
+        if ( getSimdLevel() >= SIMD_SSE2 ) x = convertRowSse2( depth, raysX.data(), raysY[row], millimetersPerUnit, width, xs, ys, zs );
+#endif
+        float rayY = raysY[row];
+        for ( ; x < width; ++x ) {
+            float z = depth[x] * millimetersPerUnit;
+            xs[x] = raysX[x] * z;
+            ys[x] = rayY * z;
+            zs[x] = z;
+        }
+    }
+
+    void PointCloudGenerator::convert( const uint16_t *depth, int strideInBytes, float *xyz, RowExecutor *executor ) const
+    {
+        if ( strideInBytes == 0 ) strideInBytes = width * sizeof( uint16_t );
+
+        auto rows = [&] ( int begin, int end ) {
+            for ( int y = begin; y < end; ++y ) {
+                const uint16_t *row = (const uint16_t *)( (const uint8_t *)depth + y * strideInBytes );
+                convertRow( row, y, xyz + y * width * 3 );
+            }
+        };
+
+        if ( executor != NULL ) executor->run( height, rows );
+        else rows( 0, height );
+    }
+
+    void PointCloudGenerator::convert( const uint16_t *depth, int strideInBytes, float *xs, float *ys, float *zs, RowExecutor *executor ) const
+    {
+        if ( strideInBytes == 0 ) strideInBytes = width * sizeof( uint16_t );
+
+        auto rows = [&] ( int begin, int end ) {
+            for ( int y = begin; y < end; ++y ) {
+                const uint16_t *row = (const uint16_t *)( (const uint8_t *)depth + y * strideInBytes );
+                size_t offset = y * width;
+                convertRow( row, y, xs + offset, ys + offset, zs + offset );
+            }
+        };
+
+        if ( executor != NULL ) executor->run( height, rows );
+        else rows( 0, height );
+    }
+
+    void PointCloudGenerator::computeNormals( const float *xyz, int width, int height, float *normals, RowExecutor *executor )
+    {
+        auto rows = [&] ( int begin, int end ) {
+            for ( int y = begin; y < end; ++y ) {
+                float *out = normals + y * width * 3;
+                memset( out, 0, width * 3 * sizeof( float ) );
+                if ( y == 0 || y == height - 1 ) continue;
+
+                const float *above = xyz + ( y - 1 ) * width * 3, *row = xyz + y * width * 3, *below = xyz + ( y + 1 ) * width * 3;
+                for ( int x = 1; x < width - 1; ++x ) {
+                    const float *left = row + ( x - 1 ) * 3, *right = row + ( x + 1 ) * 3;
+                    const float *up = above + x * 3, *down = below + x * 3;
+                    if ( row[x * 3 + 2] == 0 || left[2] == 0 || right[2] == 0 || up[2] == 0 || down[2] == 0 ) continue;
+
+                    // y points up, so right x down faces the camera
+                    float dx[3] = { right[0] - left[0], right[1] - left[1], right[2] - left[2] };
+                    float dy[3] = { down[0] - up[0], down[1] - up[1], down[2] - up[2] };
+                    float nx = dx[1] * dy[2] - dx[2] * dy[1];
+                    float ny = dx[2] * dy[0] - dx[0] * dy[2];
+                    float nz = dx[0] * dy[1] - dx[1] * dy[0];
+                    float length = std::sqrt( nx * nx + ny * ny + nz * nz );
+                    if ( length == 0 ) continue;
+
+                    out[x * 3] = nx / length;
+                    out[x * 3 + 1] = ny / length;
+                    out[x * 3 + 2] = nz / length;
+                }
+            }
+        };
+
+        if ( executor != NULL ) executor->run( height, rows );
+        else rows( 0, height );
+    }
+} }
@@ -0,0 +1,187 @@
+#include "CinderOpenNI/Registration.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace cinder { namespace openni {
+    static const int FIXED_SHIFT = 8;
+    //! fraction bits of shiftScale
+    static const int SCALE_SHIFT = 8;
+
+    DepthRegistration::DepthRegistration() :
+    depthWidth( 0 ),
+    depthHeight( 0 ),
+    colorWidth( 0 ),
+    colorHeight( 0 ),
+    indexOffset( 0 ),
+    splatWidth( 1 ),
+    splatHeight( 1 )
+    {
+    }
+
+    void DepthRegistration::allocate( int _depthWidth, int _depthHeight, int _colorWidth, int _colorHeight, uint16_t maxDepth )
+    {
+        depthWidth = _depthWidth;
+        depthHeight = _depthHeight;
+        colorWidth = _colorWidth;
+        colorHeight = _colorHeight;
+        indexOffset = 0;
+        // color pixels per depth pixel, rounded up so neighbouring depth
+        // pixels' blocks meet
+        splatWidth = std::max( 1, ( colorWidth + depthWidth - 1 ) / depthWidth );
+        splatHeight = std::max( 1, ( colorHeight + depthHeight - 1 ) / depthHeight );
+
+        baseX.assign( depthWidth * depthHeight, 0 );
+        baseY.assign( depthWidth * depthHeight, 0 );
+        shiftScale.assign( depthWidth * depthHeight, 1 << SCALE_SHIFT );
+        shiftX.assign( maxDepth + 1, 0 );
+    }
+
+    bool DepthRegistration::setup( int _depthWidth, int _depthHeight, int _colorWidth, int _colorHeight, uint16_t maxDepth,
+                                   const DepthToColor &depthToColor, uint16_t referenceDepth )
+    {
+        allocate( _depthWidth, _depthHeight, _colorWidth, _colorHeight, maxDepth );
+
+        for ( int y = 0; y < depthHeight; ++y ) {
+            for ( int x = 0; x < depthWidth; ++x ) {
+                int colorX, colorY;
+                if ( !depthToColor( x, y, referenceDepth, &colorX, &colorY ) ) {
+                    depthWidth = depthHeight = 0;
+                    return false;
+                }
+                baseX[y * depthWidth + x] = colorX << FIXED_SHIFT;
+                baseY[y * depthWidth + x] = colorY;
+            }
+        }
+
+        int centerX = depthWidth / 2, centerY = depthHeight / 2;
+        int referenceX, referenceY;
+        if ( !depthToColor( centerX, centerY, referenceDepth, &referenceX, &referenceY ) ) {
+            depthWidth = depthHeight = 0;
+            return false;
+        }
+        for ( int z = 1; z <= maxDepth; ++z ) {
+            int colorX, colorY;
+            if ( depthToColor( centerX, centerY, (uint16_t)z, &colorX, &colorY ) ) {
+                shiftX[z] = ( colorX - referenceX ) << FIXED_SHIFT;
+            }
+        }
+
+        // The shift along the baseline grows toward the image edges, so the
+        // center's shift is scaled per pixel by how far the pixel moves
+        // between a quarter and four times the reference depth, relative to
+        // the center (least squares over the samples). Mapped positions are
+        // whole pixels and the center's shift is scaled with its rounding,
+        // which leaves pixels up to about 3 pixels off where the shift
+        // varies most; more samples don't improve on that.
+        static const int SCALE_SAMPLES = 2;
+        uint16_t sampleDepths[SCALE_SAMPLES];
+        int64_t centerSquares = 0;
+        for ( int i = 0; i < SCALE_SAMPLES; ++i ) {
+            int z = referenceDepth / 4 + ( referenceDepth * 4 - referenceDepth / 4 ) * i / ( SCALE_SAMPLES - 1 );
+            sampleDepths[i] = (uint16_t)std::max( 1, std::min( (int)maxDepth, z ) );
+            centerSquares += (int64_t)shiftX[sampleDepths[i]] * shiftX[sampleDepths[i]];
+        }
+        if ( centerSquares == 0 ) return true;
+
+        for ( int y = 0; y < depthHeight; ++y ) {
+            for ( int x = 0; x < depthWidth; ++x ) {
+                int64_t products = 0;
+                bool isMapped = true;
+                for ( int i = 0; i < SCALE_SAMPLES && isMapped; ++i ) {
+                    int colorX, colorY;
+                    isMapped = depthToColor( x, y, sampleDepths[i], &colorX, &colorY );
+                    int32_t shift = ( colorX << FIXED_SHIFT ) - baseX[y * depthWidth + x];
+                    products += (int64_t)shift * shiftX[sampleDepths[i]];
+                }
+                if ( isMapped ) shiftScale[y * depthWidth + x] = (int32_t)( ( products << SCALE_SHIFT ) / centerSquares );
+            }
+        }
+
+        return true;
+    }
+
+    void DepthRegistration::setupUnregistered( int _depthWidth, int _depthHeight, int _colorWidth, int _colorHeight, uint16_t maxDepth )
+    {
+        allocate( _depthWidth, _depthHeight, _colorWidth, _colorHeight, maxDepth );
+
+        for ( int y = 0; y < depthHeight; ++y ) {
+            for ( int x = 0; x < depthWidth; ++x ) {
+                baseX[y * depthWidth + x] = ( x * colorWidth << FIXED_SHIFT ) / depthWidth;
+                baseY[y * depthWidth + x] = y * colorHeight / depthHeight;
+            }
+        }
+    }
+
+#if defined( CINDER_OPENNI_FREENECT )
+    void DepthRegistration::setup( const freenect_registration &registration )
+    {
+        // libfreenect's own resolution and depth limit
+        static const int RESOLUTION_X = 640, RESOLUTION_Y = 480;
+        static const uint16_t MAX_DEPTH = 10000;
+
+        allocate( RESOLUTION_X, RESOLUTION_Y, RESOLUTION_X, RESOLUTION_Y, MAX_DEPTH - 1 );
+
+        // both freenect tables are already in 24.8 fixed point
+        for ( int i = 0; i < RESOLUTION_X * RESOLUTION_Y; ++i ) {
+            baseX[i] = registration.registration_table[i][0];
+            baseY[i] = registration.registration_table[i][1];
+        }
+        for ( int z = 0; z < MAX_DEPTH; ++z ) shiftX[z] = registration.depth_to_rgb_shift[z];
+        indexOffset = registration.reg_pad_info.start_lines * RESOLUTION_Y;
+    }
+#endif
+
+    bool DepthRegistration::map( int depthX, int depthY, uint16_t depthZ, int *colorX, int *colorY ) const
+    {
+        if ( (uint32_t)depthX >= (uint32_t)depthWidth || (uint32_t)depthY >= (uint32_t)depthHeight ) return false;
+        if ( depthZ == 0 || depthZ >= shiftX.size() ) return false;
+
+        int pixel = depthY * depthWidth + depthX;
+        *colorX = ( baseX[pixel] + ( ( shiftX[depthZ] * shiftScale[pixel] ) >> SCALE_SHIFT ) ) >> FIXED_SHIFT;
+        // the padding is whole rows
+        *colorY = baseY[pixel] - indexOffset / colorWidth;
+        return true;
+    }
+
+    void DepthRegistration::apply( const uint16_t *depth, int strideInBytes, uint16_t *registered ) const
+    {
+        std::memset( registered, 0, colorWidth * colorHeight * sizeof( uint16_t ) );
+        if ( strideInBytes == 0 ) strideInBytes = depthWidth * sizeof( uint16_t );
+
+        const int32_t maxDepth = (int32_t)shiftX.size() - 1;
+        const int32_t colorCount = colorWidth * colorHeight;
+        const bool isOneToOne = splatWidth == 1 && splatHeight == 1;
+
+        for ( int y = 0; y < depthHeight; ++y ) {
+            const uint16_t *row = (const uint16_t *)( (const uint8_t *)depth + y * strideInBytes );
+            const int32_t *rowBaseX = &baseX[y * depthWidth];
+            const int32_t *rowBaseY = &baseY[y * depthWidth];
+            const int32_t *rowShiftScale = &shiftScale[y * depthWidth];
+
+            for ( int x = 0; x < depthWidth; ++x ) {
+                uint16_t z = row[x];
+                if ( z == 0 || z > maxDepth ) continue;
+
+                int32_t colorX = ( rowBaseX[x] + ( ( shiftX[z] * rowShiftScale[x] ) >> SCALE_SHIFT ) ) >> FIXED_SHIFT;
+                if ( (uint32_t)colorX >= (uint32_t)colorWidth ) continue;
+                int32_t index = rowBaseY[x] * colorWidth + colorX - indexOffset;
+                if ( (uint32_t)index >= (uint32_t)colorCount ) continue;
+
+                if ( isOneToOne ) {
+                    uint16_t &target = registered[index];
+                    if ( target == 0 || z < target ) target = z;
+                    continue;
+                }
+
+                int blockWidth = std::min( splatWidth, colorWidth - colorX );
+                for ( int blockY = 0; blockY < splatHeight && index < colorCount; ++blockY, index += colorWidth ) {
+                    uint16_t *target = registered + index;
+                    for ( int blockX = 0; blockX < blockWidth; ++blockX ) {
+                        if ( target[blockX] == 0 || z < target[blockX] ) target[blockX] = z;
+                    }
+                }
+            }
+        }
+    }
+} }
@@ -0,0 +1,202 @@
+#include "CinderOpenNI/SharedFrames.h"
+#include "CinderOpenNI/Trace.h"
+
+#if !defined( _WIN32 )
+
+namespace cinder { namespace openni {
+    /**************************************************************************
+     * SharedFramePublisher
+     */
+    SharedFramePublisher::SharedFramePublisher() :
+    camera( NULL ),
+    slotCount( 8 )
+    {
+    }
+
+    SharedFramePublisher::~SharedFramePublisher()
+    {
+        stop();
+    }
+
+    void SharedFramePublisher::start( CameraCore &_camera, const std::string &name, int _slotCount )
+    {
+        stop();
+        camera = &_camera;
+        slotCount = _slotCount < 2 ? 2 : _slotCount;
+
+        if ( camera->hasDepth() ) {
+            setupStream( depth, name, "depth", _openni::SENSOR_DEPTH, camera->getDepthFieldOfView(), camera->getDepthMetadata().maxValue );
+            depth.callbackId = camera->onDepthFrame( [this] ( const FrameEvent &event ) { publish( depth, event ); } );
+        }
+        if ( camera->hasColor() ) {
+            setupStream( color, name, "color", _openni::SENSOR_COLOR, camera->getColorFieldOfView(), 255 );
+            color.callbackId = camera->onColorFrame( [this] ( const FrameEvent &event ) { publish( color, event ); } );
+        }
+    }
+
+    void SharedFramePublisher::setupStream( Stream &stream, const std::string &name, const char *streamName, _openni::SensorType sensorType,
+                                            Vec2f fov, int maxValue )
+    {
+        stream.ringName = getSharedRingName( name, streamName );
+        stream.format.sensorType = sensorType;
+        stream.format.maxValue = maxValue;
+        stream.format.horizontalFov = fov.x;
+        stream.format.verticalFov = fov.y;
+        stream.bytesPerPixel = sensorType == _openni::SENSOR_DEPTH ? sizeof( _openni::DepthPixel ) : sizeof( _openni::RGB888Pixel );
+        stream.isFailed = false;
+    }
+
+    void SharedFramePublisher::stop()
+    {
+        if ( camera == NULL ) return;
+
+        // once removed, no callback is running or will run; the camera may
+        // have been closed since, the callbacks are registered all the same
+        if ( depth.callbackId != 0 ) camera->removeFrameCallback( depth.callbackId );
+        if ( color.callbackId != 0 ) camera->removeFrameCallback( color.callbackId );
+        depth.callbackId = color.callbackId = 0;
+        depth.ring.close();
+        color.ring.close();
+        camera = NULL;
+    }
+
+    void SharedFramePublisher::publish( Stream &stream, const FrameEvent &event )
+    {
+        if ( stream.isFailed ) return;
+
+        CI_OPENNI_TRACE_SCOPE( "SharedFramePublisher::publish" );
+        const _openni::VideoFrameRef &frameRef = event.getFrameRef();
+        Vec2i size = event.getSize();
+        uint32_t dataSize = size.x * size.y * stream.bytesPerPixel;
+
+        // first frame, or a video mode change that needs bigger slots;
+        // subscribers notice the old ring closing and open the new one
+        if ( !stream.ring.isOpen() || stream.ring.getHeader().slotDataSize < dataSize ) {
+            _openni::VideoMode mode = frameRef.getVideoMode();
+            stream.format.pixelFormat = mode.getPixelFormat();
+            stream.format.width = size.x;
+            stream.format.height = size.y;
+            stream.format.fps = mode.getFps();
+            if ( !stream.ring.create( stream.ringName, stream.format, slotCount, dataSize ) ) {
+                CameraCore::log() << "Could not create shared memory ring " << stream.ringName << std::endl;
+                stream.isFailed = true;
+                return;
+            }
+        }
+
+        stream.ring.write( event.getData(), event.getStrideInBytes(), size.x, size.y, stream.bytesPerPixel, event.getTimestamp(),
+                           event.getFrameIndex() );
+    }
+
+    /**************************************************************************
+     * SharedCamera
+     */
+    SharedCamera::SharedCamera()
+    {
+    }
+
+    void SharedCamera::setup( const std::string &name )
+    {
+        close();
+        depth.ringName = getSharedRingName( name, "depth" );
+        color.ringName = getSharedRingName( name, "color" );
+        update();
+    }
+
+    void SharedCamera::close()
+    {
+        depthChannel = Channel16u();
+        colorSurface = Surface8u();
+        closeRing( depth );
+        closeRing( color );
+    }
+
+    void SharedCamera::closeRing( Stream &stream )
+    {
+        // channels and surfaces still wrapping the old ring's frames keep
+        // it mapped
+        if ( stream.ring.unique() ) stream.ring->close();
+        else stream.ring.reset( new SharedFrameRing() );
+        stream.frame = SharedFrameView();
+        stream.hasView = false;
+    }
+
+    bool SharedCamera::update()
+    {
+        bool isDepthNew = updateStream( depth );
+        bool isColorNew = updateStream( color );
+        return isDepthNew || isColorNew;
+    }
+
+    bool SharedCamera::updateStream( Stream &stream )
+    {
+        if ( stream.ringName.empty() ) return false;
+
+        // the publisher is gone or recreated the ring
+        if ( stream.ring->isOpen() && stream.ring->isClosed() ) closeRing( stream );
+        // a shm_open() per update until the publisher shows up
+        if ( !stream.ring->isOpen() && !stream.ring->open( stream.ringName ) ) return false;
+
+        SharedFrameView frame;
+        if ( !stream.ring->readLatest( frame ) ) return false;
+        if ( stream.frame.slot != NULL && frame.frameNumber <= stream.frame.frameNumber ) return false;
+
+        if ( stream.frame.slot != NULL ) stream.framesSkipped += frame.frameNumber - stream.frame.frameNumber - 1;
+        stream.frame = frame;
+        return true;
+    }
+
+    // Deallocator for channels and surfaces that wrap a ring's frame.
+    static void releaseRing( void *ring )
+    {
+        delete (std::shared_ptr< SharedFrameRing > *)ring;
+    }
+
+    Channel16u SharedCamera::getDepthChannel16u()
+    {
+        if ( depth.frame.slot == NULL ) return Channel16u();
+        if ( depth.hasView && depth.viewFrameNumber == depth.frame.frameNumber ) return depthChannel;
+
+        depthChannel = Channel16u( depth.frame.width, depth.frame.height, depth.frame.strideInBytes, 1, (uint16_t *)depth.frame.data );
+        depthChannel.setDeallocator( releaseRing, new std::shared_ptr< SharedFrameRing >( depth.ring ) );
+        depth.viewFrameNumber = depth.frame.frameNumber;
+        depth.hasView = true;
+        return depthChannel;
+    }
+
+    Surface8u SharedCamera::getColorSurface()
+    {
+        if ( color.frame.slot == NULL ) return Surface8u();
+        if ( color.hasView && color.viewFrameNumber == color.frame.frameNumber ) return colorSurface;
+
+        colorSurface = Surface8u( (uint8_t *)color.frame.data, color.frame.width, color.frame.height, color.frame.strideInBytes,
+                                  SurfaceChannelOrder::RGB );
+        colorSurface.setDeallocator( releaseRing, new std::shared_ptr< SharedFrameRing >( color.ring ) );
+        color.viewFrameNumber = color.frame.frameNumber;
+        color.hasView = true;
+        return colorSurface;
+    }
+
+    CameraCore::DepthMetadata SharedCamera::getDepthMetadata() const
+    {
+        CameraCore::DepthMetadata metadata;
+        memset( &metadata, 0, sizeof( metadata ) );
+        if ( !depth.ring->isOpen() ) return metadata;
+
+        const SharedRingHeader &header = depth.ring->getHeader();
+        metadata.maxValue = (uint16_t)header.maxValue;
+        metadata.millimetersPerUnit = header.pixelFormat == _openni::PIXEL_FORMAT_DEPTH_100_UM ? 0.1f : 1.0f;
+        metadata.texScale = 65535.0f;
+        return metadata;
+    }
+
+    Vec2f SharedCamera::getDepthFieldOfView() const
+    {
+        if ( !depth.ring->isOpen() ) return Vec2f::zero();
+
+        const SharedRingHeader &header = depth.ring->getHeader();
+        return Vec2f( header.horizontalFov, header.verticalFov );
+    }
+} }
+
+#endif
@@ -0,0 +1,440 @@
+#include "CinderOpenNI/SpatialFilter.h"
+#include "CinderOpenNI/DepthConversion.h"
+#include "CinderOpenNI/Parallel.h"
+
+#include <cstring>
+
+#if defined( _M_X64 ) || defined( _M_IX86 ) || defined( __x86_64__ ) || defined( __i386__ )
+#   define CI_OPENNI_X86
+#   include <emmintrin.h>
+#   if defined( __GNUC__ ) || ( defined( _MSC_VER ) && _MSC_VER >= 1800 )
+#       define CI_OPENNI_AVX2
+#       include <immintrin.h>
+#   endif
+#endif
+
+#if defined( __GNUC__ )
+#   define CI_OPENNI_TARGET( isa ) __attribute__(( target( isa ) ))
+#else
+#   define CI_OPENNI_TARGET( isa )
+#endif
+
+namespace cinder { namespace openni {
+    static inline int depthDifference( int a, int b )
+    {
+        return a > b ? a - b : b - a;
+    }
+
+    // The scalar kernels run over [begin, width - 1), the SIMD ones hand
+    // them whatever is left of the row. Edge pixels are copied.
+    static void removeFlyingPixelsSpan( const uint16_t *above, const uint16_t *row, const uint16_t *below, uint16_t *out,
+                                        int begin, int width, uint16_t threshold )
+    {
+        for ( int x = begin; x < width - 1; ++x ) {
+            int z = row[x];
+            bool isHorizontalEdge = depthDifference( z, row[x - 1] ) > threshold && depthDifference( z, row[x + 1] ) > threshold;
+            bool isVerticalEdge = depthDifference( z, above[x] ) > threshold && depthDifference( z, below[x] ) > threshold;
+            out[x] = isHorizontalEdge || isVerticalEdge ? 0 : (uint16_t)z;
+        }
+        out[0] = row[0];
+        out[width - 1] = row[width - 1];
+    }
+
+    static void fillHolesSpan( const uint16_t *above, const uint16_t *row, const uint16_t *below, uint16_t *out,
+                               int begin, int width, int neighbors )
+    {
+        for ( int x = begin; x < width - 1; ++x ) {
+            out[x] = row[x];
+            if ( row[x] != 0 ) continue;
+
+            uint16_t around[8] = { above[x - 1], above[x], above[x + 1], row[x - 1], row[x + 1], below[x - 1], below[x], below[x + 1] };
+            int valid = 0;
+            uint16_t farthest = 0;
+            for ( int i = 0; i < 8; ++i ) {
+                if ( around[i] != 0 ) ++valid;
+                if ( around[i] > farthest ) farthest = around[i];
+            }
+            if ( valid >= neighbors ) out[x] = farthest;
+        }
+        out[0] = row[0];
+        out[width - 1] = row[width - 1];
+    }
+
+    static void smoothSpan( const uint16_t *above, const uint16_t *row, const uint16_t *below, uint16_t *out,
+                            int begin, int width, uint16_t threshold )
+    {
+        for ( int x = begin; x < width - 1; ++x ) {
+            int z = row[x];
+            if ( z == 0 ) {
+                out[x] = 0;
+                continue;
+            }
+
+            const uint16_t *rows[3] = { above, row, below };
+            int sum = 0, count = 0;
+            for ( int r = 0; r < 3; ++r ) {
+                for ( int dx = -1; dx <= 1; ++dx ) {
+                    int n = rows[r][x + dx];
+                    if ( n == 0 || depthDifference( n, z ) > threshold ) continue;
+                    sum += n;
+                    ++count;
+                }
+            }
+            // the same float math as the SIMD kernels, so they match exactly
+            out[x] = (uint16_t)(int)( (float)sum / (float)count + 0.5f );
+        }
+        out[0] = row[0];
+        out[width - 1] = row[width - 1];
+    }
+
+#if defined( CI_OPENNI_X86 )
+    // a > b for unsigned 16 bit lanes
+    CI_OPENNI_TARGET( "sse2" )
+    static inline __m128i isGreaterSse2( __m128i a, __m128i b, __m128i zero )
+    {
+        return _mm_xor_si128( _mm_cmpeq_epi16( _mm_subs_epu16( a, b ), zero ), _mm_cmpeq_epi16( zero, zero ) );
+    }
+
+    CI_OPENNI_TARGET( "sse2" )
+    static inline __m128i differenceSse2( __m128i a, __m128i b )
+    {
+        return _mm_or_si128( _mm_subs_epu16( a, b ), _mm_subs_epu16( b, a ) );
+    }
+
+    CI_OPENNI_TARGET( "sse2" )
+    static int removeFlyingPixelsSse2( const uint16_t *above, const uint16_t *row, const uint16_t *below, uint16_t *out,
+                                       int width, uint16_t threshold )
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i thresholds = _mm_set1_epi16( (short)threshold );
+        int x = 1;
+
+        for ( ; x + 9 <= width; x += 8 ) {
+            __m128i z = _mm_loadu_si128( (const __m128i *)( row + x ) );
+            __m128i left = isGreaterSse2( differenceSse2( z, _mm_loadu_si128( (const __m128i *)( row + x - 1 ) ) ), thresholds, zero );
+            __m128i right = isGreaterSse2( differenceSse2( z, _mm_loadu_si128( (const __m128i *)( row + x + 1 ) ) ), thresholds, zero );
+            __m128i up = isGreaterSse2( differenceSse2( z, _mm_loadu_si128( (const __m128i *)( above + x ) ) ), thresholds, zero );
+            __m128i down = isGreaterSse2( differenceSse2( z, _mm_loadu_si128( (const __m128i *)( below + x ) ) ), thresholds, zero );
+            __m128i isFlying = _mm_or_si128( _mm_and_si128( left, right ), _mm_and_si128( up, down ) );
+            _mm_storeu_si128( (__m128i *)( out + x ), _mm_andnot_si128( isFlying, z ) );
+        }
+        return x;
+    }
+
+    CI_OPENNI_TARGET( "sse2" )
+    static int fillHolesSse2( const uint16_t *above, const uint16_t *row, const uint16_t *below, uint16_t *out,
+                              int width, int neighbors )
+    {
+        const __m128i zero = _mm_setzero_si128();
+        // signed max on values biased by 0x8000 orders like unsigned
+        const __m128i bias = _mm_set1_epi16( (short)0x8000 );
+        const __m128i minValid = _mm_set1_epi16( (short)( neighbors - 1 ) );
+        int x = 1;
+
+        for ( ; x + 9 <= width; x += 8 ) {
+            __m128i around[8] = {
+                _mm_loadu_si128( (const __m128i *)( above + x - 1 ) ),
+                _mm_loadu_si128( (const __m128i *)( above + x ) ),
+                _mm_loadu_si128( (const __m128i *)( above + x + 1 ) ),
+                _mm_loadu_si128( (const __m128i *)( row + x - 1 ) ),
+                _mm_loadu_si128( (const __m128i *)( row + x + 1 ) ),
+                _mm_loadu_si128( (const __m128i *)( below + x - 1 ) ),
+                _mm_loadu_si128( (const __m128i *)( below + x ) ),
+                _mm_loadu_si128( (const __m128i *)( below + x + 1 ) )
+            };
+            // every invalid neighbor subtracts one
+            __m128i valid = _mm_set1_epi16( 8 );
+            __m128i farthest = bias;
+            for ( int i = 0; i < 8; ++i ) {
+                valid = _mm_add_epi16( valid, _mm_cmpeq_epi16( around[i], zero ) );
+                farthest = _mm_max_epi16( farthest, _mm_xor_si128( around[i], bias ) );
+            }
+            farthest = _mm_xor_si128( farthest, bias );
+
+            __m128i z = _mm_loadu_si128( (const __m128i *)( row + x ) );
+            __m128i fill = _mm_and_si128( _mm_cmpeq_epi16( z, zero ), _mm_cmpgt_epi16( valid, minValid ) );
+            _mm_storeu_si128( (__m128i *)( out + x ), _mm_or_si128( _mm_and_si128( fill, farthest ), _mm_andnot_si128( fill, z ) ) );
+        }
+        return x;
+    }
+
+    CI_OPENNI_TARGET( "sse2" )
+    static int smoothSse2( const uint16_t *above, const uint16_t *row, const uint16_t *below, uint16_t *out,
+                           int width, uint16_t threshold )
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i one = _mm_set1_epi16( 1 );
+        const __m128i thresholds = _mm_set1_epi16( (short)threshold );
+        const __m128i bias32 = _mm_set1_epi32( 0x8000 );
+        const __m128i bias16 = _mm_set1_epi16( (short)0x8000 );
+        const __m128 half = _mm_set1_ps( 0.5f );
+        const uint16_t *rows[3] = { above, row, below };
+        int x = 1;
+
+        for ( ; x + 9 <= width; x += 8 ) {
+            __m128i z = _mm_loadu_si128( (const __m128i *)( row + x ) );
+            __m128i sumLo = zero, sumHi = zero, count = zero;
+            for ( int r = 0; r < 3; ++r ) {
+                for ( int dx = -1; dx <= 1; ++dx ) {
+                    __m128i n = _mm_loadu_si128( (const __m128i *)( rows[r] + x + dx ) );
+                    __m128i isClose = _mm_cmpeq_epi16( _mm_subs_epu16( differenceSse2( n, z ), thresholds ), zero );
+                    __m128i isUsed = _mm_andnot_si128( _mm_cmpeq_epi16( n, zero ), isClose );
+                    n = _mm_and_si128( n, isUsed );
+                    sumLo = _mm_add_epi32( sumLo, _mm_unpacklo_epi16( n, zero ) );
+                    sumHi = _mm_add_epi32( sumHi, _mm_unpackhi_epi16( n, zero ) );
+                    count = _mm_sub_epi16( count, isUsed );
+                }
+            }
+            // invalid centers have nothing to average, they are masked below
+            count = _mm_max_epi16( count, one );
+            __m128 averageLo = _mm_div_ps( _mm_cvtepi32_ps( sumLo ), _mm_cvtepi32_ps( _mm_unpacklo_epi16( count, zero ) ) );
+            __m128 averageHi = _mm_div_ps( _mm_cvtepi32_ps( sumHi ), _mm_cvtepi32_ps( _mm_unpackhi_epi16( count, zero ) ) );
+            __m128i lo = _mm_sub_epi32( _mm_cvttps_epi32( _mm_add_ps( averageLo, half ) ), bias32 );
+            __m128i hi = _mm_sub_epi32( _mm_cvttps_epi32( _mm_add_ps( averageHi, half ) ), bias32 );
+            // no unsigned 32 to 16 bit pack before SSE4.1, pack biased values
+            __m128i average = _mm_xor_si128( _mm_packs_epi32( lo, hi ), bias16 );
+            _mm_storeu_si128( (__m128i *)( out + x ), _mm_andnot_si128( _mm_cmpeq_epi16( z, zero ), average ) );
+        }
+        return x;
+    }
+#endif
+
+#if defined( CI_OPENNI_AVX2 )
+    CI_OPENNI_TARGET( "avx2" )
+    static inline __m256i isGreaterAvx2( __m256i a, __m256i b, __m256i zero )
+    {
+        return _mm256_xor_si256( _mm256_cmpeq_epi16( _mm256_subs_epu16( a, b ), zero ), _mm256_cmpeq_epi16( zero, zero ) );
+    }
+
+    CI_OPENNI_TARGET( "avx2" )
+    static inline __m256i differenceAvx2( __m256i a, __m256i b )
+    {
+        return _mm256_or_si256( _mm256_subs_epu16( a, b ), _mm256_subs_epu16( b, a ) );
+    }
+
+    CI_OPENNI_TARGET( "avx2" )
+    static int removeFlyingPixelsAvx2( const uint16_t *above, const uint16_t *row, const uint16_t *below, uint16_t *out,
+                                       int width, uint16_t threshold )
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i thresholds = _mm256_set1_epi16( (short)threshold );
+        int x = 1;
+
+        for ( ; x + 17 <= width; x += 16 ) {
+            __m256i z = _mm256_loadu_si256( (const __m256i *)( row + x ) );
+            __m256i left = isGreaterAvx2( differenceAvx2( z, _mm256_loadu_si256( (const __m256i *)( row + x - 1 ) ) ), thresholds, zero );
+            __m256i right = isGreaterAvx2( differenceAvx2( z, _mm256_loadu_si256( (const __m256i *)( row + x + 1 ) ) ), thresholds, zero );
+            __m256i up = isGreaterAvx2( differenceAvx2( z, _mm256_loadu_si256( (const __m256i *)( above + x ) ) ), thresholds, zero );
+            __m256i down = isGreaterAvx2( differenceAvx2( z, _mm256_loadu_si256( (const __m256i *)( below + x ) ) ), thresholds, zero );
+            __m256i isFlying = _mm256_or_si256( _mm256_and_si256( left, right ), _mm256_and_si256( up, down ) );
+            _mm256_storeu_si256( (__m256i *)( out + x ), _mm256_andnot_si256( isFlying, z ) );
+        }
+        return x;
+    }
+
+    CI_OPENNI_TARGET( "avx2" )
+    static int fillHolesAvx2( const uint16_t *above, const uint16_t *row, const uint16_t *below, uint16_t *out,
+                              int width, int neighbors )
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i minValid = _mm256_set1_epi16( (short)( neighbors - 1 ) );
+        const uint16_t *rows[3] = { above, row, below };
+        int x = 1;
+
+        for ( ; x + 17 <= width; x += 16 ) {
+            __m256i valid = _mm256_set1_epi16( 8 );
+            __m256i farthest = zero;
+            for ( int r = 0; r < 3; ++r ) {
+                for ( int dx = -1; dx <= 1; ++dx ) {
+                    if ( r == 1 && dx == 0 ) continue;
+                    __m256i n = _mm256_loadu_si256( (const __m256i *)( rows[r] + x + dx ) );
+                    valid = _mm256_add_epi16( valid, _mm256_cmpeq_epi16( n, zero ) );
+                    farthest = _mm256_max_epu16( farthest, n );
+                }
+            }
+
+            __m256i z = _mm256_loadu_si256( (const __m256i *)( row + x ) );
+            __m256i fill = _mm256_and_si256( _mm256_cmpeq_epi16( z, zero ), _mm256_cmpgt_epi16( valid, minValid ) );
+            _mm256_storeu_si256( (__m256i *)( out + x ), _mm256_blendv_epi8( z, farthest, fill ) );
+        }
+        return x;
+    }
+
+    CI_OPENNI_TARGET( "avx2" )
+    static int smoothAvx2( const uint16_t *above, const uint16_t *row, const uint16_t *below, uint16_t *out,
+                           int width, uint16_t threshold )
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i one = _mm256_set1_epi16( 1 );
+        const __m256i thresholds = _mm256_set1_epi16( (short)threshold );
+        const __m256 half = _mm256_set1_ps( 0.5f );
+        const uint16_t *rows[3] = { above, row, below };
+        int x = 1;
+
+        for ( ; x + 17 <= width; x += 16 ) {
+            __m256i z = _mm256_loadu_si256( (const __m256i *)( row + x ) );
+            __m256i sumLo = zero, sumHi = zero, count = zero;
+            for ( int r = 0; r < 3; ++r ) {
+                for ( int dx = -1; dx <= 1; ++dx ) {
+                    __m256i n = _mm256_loadu_si256( (const __m256i *)( rows[r] + x + dx ) );
+                    __m256i isClose = _mm256_cmpeq_epi16( _mm256_subs_epu16( differenceAvx2( n, z ), thresholds ), zero );
+                    __m256i isUsed = _mm256_andnot_si256( _mm256_cmpeq_epi16( n, zero ), isClose );
+                    n = _mm256_and_si256( n, isUsed );
+                    sumLo = _mm256_add_epi32( sumLo, _mm256_unpacklo_epi16( n, zero ) );
+                    sumHi = _mm256_add_epi32( sumHi, _mm256_unpackhi_epi16( n, zero ) );
+                    count = _mm256_sub_epi16( count, isUsed );
+                }
+            }
+            count = _mm256_max_epi16( count, one );
+            __m256 averageLo = _mm256_div_ps( _mm256_cvtepi32_ps( sumLo ), _mm256_cvtepi32_ps( _mm256_unpacklo_epi16( count, zero ) ) );
+            __m256 averageHi = _mm256_div_ps( _mm256_cvtepi32_ps( sumHi ), _mm256_cvtepi32_ps( _mm256_unpackhi_epi16( count, zero ) ) );
+            // unpack and pack both work per 128 bit lane, so this restores
+            // the pixel order
+            __m256i average = _mm256_packus_epi32( _mm256_cvttps_epi32( _mm256_add_ps( averageLo, half ) ),
+                                                   _mm256_cvttps_epi32( _mm256_add_ps( averageHi, half ) ) );
+            _mm256_storeu_si256( (__m256i *)( out + x ), _mm256_andnot_si256( _mm256_cmpeq_epi16( z, zero ), average ) );
+        }
+        return x;
+    }
+#endif
+
+    SpatialDepthFilter::SpatialDepthFilter() :
+    stages( STAGE_FLYING_PIXELS | STAGE_HOLE_FILL | STAGE_SMOOTH ),
+    flyingPixelThreshold( 100 ),
+    holeFillNeighbors( 3 ),
+    smoothThreshold( 30 ),
+    width( 0 ),
+    height( 0 )
+    {
+    }
+
+    void SpatialDepthFilter::removeFlyingPixelsRowScalar( const uint16_t *above, const uint16_t *row, const uint16_t *below, uint16_t *out,
+                                                          int width, uint16_t threshold )
+    {
+        removeFlyingPixelsSpan( above, row, below, out, 1, width, threshold );
+    }
+
+    void SpatialDepthFilter::removeFlyingPixelsRow( const uint16_t *above, const uint16_t *row, const uint16_t *below, uint16_t *out,
+                                                    int width, uint16_t threshold )
+    {
+        int x = 1;
+#if defined( CI_OPENNI_AVX2 )
+        if ( getSimdLevel() >= SIMD_AVX2 ) x = removeFlyingPixelsAvx2( above, row, below, out, width, threshold );
+        else
+#endif
+#if defined( CI_OPENNI_X86 )
+        if ( getSimdLevel() >= SIMD_SSE2 ) x = removeFlyingPixelsSse2( above, row, below, out, width, threshold );
+#endif
+        removeFlyingPixelsSpan( above, row, below, out, x, width, threshold );
+    }
+
+    void SpatialDepthFilter::fillHolesRowScalar( const uint16_t *above, const uint16_t *row, const uint16_t *below, uint16_t *out,
+                                                 int width, int neighbors )
+    {
+        fillHolesSpan( above, row, below, out, 1, width, neighbors );
+    }
+
+    void SpatialDepthFilter::fillHolesRow( const uint16_t *above, const uint16_t *row, const uint16_t *below, uint16_t *out,
+                                           int width, int neighbors )
+    {
+        int x = 1;
+#if defined( CI_OPENNI_AVX2 )
+        if ( getSimdLevel() >= SIMD_AVX2 ) x = fillHolesAvx2( above, row, below, out, width, neighbors );
+        else
+#endif
+#if defined( CI_OPENNI_X86 )
+        if ( getSimdLevel() >= SIMD_SSE2 ) x = fillHolesSse2( above, row, below, out, width, neighbors );
+#endif
+        fillHolesSpan( above, row, below, out, x, width, neighbors );
+    }
+
+    void SpatialDepthFilter::smoothRowScalar( const uint16_t *above, const uint16_t *row, const uint16_t *below, uint16_t *out,
+                                              int width, uint16_t threshold )
+    {
+        smoothSpan( above, row, below, out, 1, width, threshold );
+    }
+
+    void SpatialDepthFilter::smoothRow( const uint16_t *above, const uint16_t *row, const uint16_t *below, uint16_t *out,
+                                        int width, uint16_t threshold )
+    {
+        int x = 1;
+#if defined( CI_OPENNI_AVX2 )
+        if ( getSimdLevel() >= SIMD_AVX2 ) x = smoothAvx2( above, row, below, out, width, threshold );
+        else
+#endif
+#if defined( CI_OPENNI_X86 )
+        if ( getSimdLevel() >= SIMD_SSE2 ) x = smoothSse2( above, row, below, out, width, threshold );
+#endif
+        smoothSpan( above, row, below, out, x, width, threshold );
+    }
+
+    void SpatialDepthFilter::filterRows( int stage, const uint16_t *src, int strideInBytes, uint16_t *dst, int beginRow, int endRow )
+    {
+        for ( int y = beginRow; y < endRow; ++y ) {
+            const uint16_t *row = (const uint16_t *)( (const uint8_t *)src + y * strideInBytes );
+            uint16_t *out = dst + y * width;
+
+            // border rows have no neighbors to work with
+            if ( y == 0 || y == height - 1 || width < 3 ) {
+                std::memcpy( out, row, width * sizeof( uint16_t ) );
+                continue;
+            }
+
+            const uint16_t *above = (const uint16_t *)( (const uint8_t *)row - strideInBytes );
+            const uint16_t *below = (const uint16_t *)( (const uint8_t *)row + strideInBytes );
+            switch ( stage ) {
+                case STAGE_FLYING_PIXELS: removeFlyingPixelsRow( above, row, below, out, width, flyingPixelThreshold ); break;
+                case STAGE_HOLE_FILL: fillHolesRow( above, row, below, out, width, holeFillNeighbors ); break;
+                default: smoothRow( above, row, below, out, width, smoothThreshold ); break;
+            }
+        }
+    }
+
+    void SpatialDepthFilter::apply( const uint16_t *depth, int strideInBytes, int _width, int _height, RowExecutor *executor )
+    {
+        if ( strideInBytes == 0 ) strideInBytes = _width * sizeof( uint16_t );
+        if ( width != _width || height != _height ) {
+            width = _width;
+            height = _height;
+            filtered.resize( (size_t)width * height );
+            scratch.resize( (size_t)width * height );
+        }
+
+        int stageList[3], stageCount = 0;
+        if ( stages & STAGE_FLYING_PIXELS ) stageList[stageCount++] = STAGE_FLYING_PIXELS;
+        if ( stages & STAGE_HOLE_FILL ) stageList[stageCount++] = STAGE_HOLE_FILL;
+        if ( stages & STAGE_SMOOTH ) stageList[stageCount++] = STAGE_SMOOTH;
+
+        if ( stageCount == 0 ) {
+            for ( int y = 0; y < height; ++y ) {
+                std::memcpy( &filtered[y * width], (const uint8_t *)depth + y * strideInBytes, width * sizeof( uint16_t ) );
+            }
+            return;
+        }
+
+        // every stage reads the whole output of the one before, so they run
+        // one after the other, alternating buffers so the last one ends up
+        // in filtered
+        struct Pass {
+            SpatialDepthFilter *filter;
+            int stage;
+            const uint16_t *src;
+            int strideInBytes;
+            uint16_t *dst;
+        } pass = { this, 0, depth, strideInBytes, NULL };
+        // one reference to capture keeps the task small enough for
+        // std::function to hold it without allocating
+        auto rows = [&pass] ( int begin, int end ) { pass.filter->filterRows( pass.stage, pass.src, pass.strideInBytes, pass.dst, begin, end ); };
+
+        for ( int i = 0; i < stageCount; ++i ) {
+            pass.stage = stageList[i];
+            pass.dst = ( stageCount - 1 - i ) % 2 == 0 ? filtered.data() : scratch.data();
+
+            if ( executor != NULL ) executor->run( height, rows );
+            else rows( 0, height );
+
+            pass.src = pass.dst;
+            pass.strideInBytes = width * sizeof( uint16_t );
+        }
+    }
+} }
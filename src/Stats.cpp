@@ -0,0 +1,34 @@
+#include "CinderOpenNI/Stats.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace cinder { namespace openni {
+    uint64_t getHostTimeUs()
+    {
+        return std::chrono::duration_cast< std::chrono::microseconds >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+    }
+
+    RollingSamples::RollingSamples() :
+    next( 0 )
+    {
+        for ( int i = 0; i < CAPACITY; ++i ) samples[i].store( 0, std::memory_order_relaxed );
+    }
+
+    Percentiles RollingSamples::getPercentiles() const
+    {
+        uint32_t count = std::min< uint32_t >( next.load( std::memory_order_acquire ), CAPACITY );
+        uint32_t sorted[CAPACITY];
+        for ( uint32_t i = 0; i < count; ++i ) sorted[i] = samples[i].load( std::memory_order_relaxed );
+        std::sort( sorted, sorted + count );
+
+        Percentiles percentiles = { 0, 0, 0, 0, count };
+        if ( count == 0 ) return percentiles;
+
+        percentiles.p50 = sorted[( count - 1 ) * 50 / 100];
+        percentiles.p95 = sorted[( count - 1 ) * 95 / 100];
+        percentiles.p99 = sorted[( count - 1 ) * 99 / 100];
+        percentiles.max = sorted[count - 1];
+        return percentiles;
+    }
+} }
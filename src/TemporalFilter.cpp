@@ -0,0 +1,351 @@
+#include "CinderOpenNI/TemporalFilter.h"
+#include "CinderOpenNI/DepthConversion.h"
+#include "CinderOpenNI/Parallel.h"
+
+#include <cstring>
+
+#if defined( _M_X64 ) || defined( _M_IX86 ) || defined( __x86_64__ ) || defined( __i386__ )
+#   define CI_OPENNI_X86
+#   include <emmintrin.h>
+#   if defined( __GNUC__ ) || ( defined( _MSC_VER ) && _MSC_VER >= 1800 )
+#       define CI_OPENNI_AVX2
+#       include <immintrin.h>
+#   endif
+#endif
+
+#if defined( __GNUC__ )
+#   define CI_OPENNI_TARGET( isa ) __attribute__(( target( isa ) ))
+#else
+#   define CI_OPENNI_TARGET( isa )
+#endif
+
+namespace cinder { namespace openni {
+    static inline uint16_t median3( uint16_t a, uint16_t b, uint16_t c )
+    {
+        uint16_t lo = a < b ? a : b, hi = a < b ? b : a;
+        uint16_t hiC = hi < c ? hi : c;
+        return lo > hiC ? lo : hiC;
+    }
+
+    // median of five as a median of three, which maps onto min/max
+    static inline uint16_t median5( uint16_t a, uint16_t b, uint16_t c, uint16_t d, uint16_t e )
+    {
+        uint16_t minAB = a < b ? a : b, maxAB = a < b ? b : a;
+        uint16_t minCD = c < d ? c : d, maxCD = c < d ? d : c;
+        return median3( e, minAB > minCD ? minAB : minCD, maxAB < maxCD ? maxAB : maxCD );
+    }
+
+#if defined( CI_OPENNI_X86 )
+    CI_OPENNI_TARGET( "sse2" )
+    static int averageRowSse2( const uint16_t *depth, uint16_t *filtered, int count, int weight, uint16_t threshold )
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i weights = _mm_set1_epi16( (short)( weight << 8 ) );
+        const __m128i thresholds = _mm_set1_epi16( (short)threshold );
+        int x = 0;
+
+        for ( ; x + 8 <= count; x += 8 ) {
+            __m128i d = _mm_loadu_si128( (const __m128i *)( depth + x ) );
+            __m128i f = _mm_loadu_si128( (const __m128i *)( filtered + x ) );
+            __m128i up = _mm_subs_epu16( d, f );
+            __m128i difference = _mm_or_si128( up, _mm_subs_epu16( f, d ) );
+            __m128i step = _mm_mulhi_epu16( difference, weights );
+
+            __m128i isDown = _mm_cmpeq_epi16( up, zero );
+            __m128i moved = _mm_or_si128( _mm_and_si128( isDown, _mm_sub_epi16( f, step ) ),
+                                          _mm_andnot_si128( isDown, _mm_add_epi16( f, step ) ) );
+
+            __m128i isSmall = _mm_cmpeq_epi16( _mm_subs_epu16( difference, thresholds ), zero );
+            __m128i isInvalid = _mm_or_si128( _mm_cmpeq_epi16( d, zero ), _mm_cmpeq_epi16( f, zero ) );
+            __m128i keep = _mm_andnot_si128( isInvalid, isSmall );
+            _mm_storeu_si128( (__m128i *)( filtered + x ), _mm_or_si128( _mm_and_si128( keep, moved ), _mm_andnot_si128( keep, d ) ) );
+        }
+        return x;
+    }
+
+    // signed min/max on values biased by 0x8000 order like unsigned ones
+    CI_OPENNI_TARGET( "sse2" )
+    static inline __m128i median3Sse2( __m128i a, __m128i b, __m128i c )
+    {
+        return _mm_max_epi16( _mm_min_epi16( a, b ), _mm_min_epi16( _mm_max_epi16( a, b ), c ) );
+    }
+
+    CI_OPENNI_TARGET( "sse2" )
+    static int medianRowSse2( uint16_t *const *history, int frames, int newest, const uint16_t *depth, uint16_t *filtered,
+                              int count, uint16_t threshold )
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i bias = _mm_set1_epi16( (short)0x8000 );
+        const __m128i thresholds = _mm_set1_epi16( (short)threshold );
+        int x = 0;
+
+        for ( ; x + 8 <= count; x += 8 ) {
+            __m128i d = _mm_loadu_si128( (const __m128i *)( depth + x ) );
+            __m128i f = _mm_loadu_si128( (const __m128i *)( filtered + x ) );
+            __m128i difference = _mm_or_si128( _mm_subs_epu16( d, f ), _mm_subs_epu16( f, d ) );
+            __m128i isSmall = _mm_cmpeq_epi16( _mm_subs_epu16( difference, thresholds ), zero );
+            __m128i isInvalid = _mm_or_si128( _mm_cmpeq_epi16( d, zero ), _mm_cmpeq_epi16( f, zero ) );
+            __m128i stays = _mm_or_si128( isInvalid, isSmall );
+
+            __m128i values[TemporalDepthFilter::MAX_MEDIAN_FRAMES];
+            for ( int i = 0; i < frames; ++i ) {
+                __m128i h = d;
+                if ( i != newest ) {
+                    h = _mm_loadu_si128( (const __m128i *)( history[i] + x ) );
+                    h = _mm_or_si128( _mm_and_si128( stays, h ), _mm_andnot_si128( stays, d ) );
+                }
+                _mm_storeu_si128( (__m128i *)( history[i] + x ), h );
+                values[i] = _mm_xor_si128( h, bias );
+            }
+
+            __m128i median;
+            if ( frames == 3 ) {
+                median = median3Sse2( values[0], values[1], values[2] );
+            }
+            else {
+                __m128i lo = _mm_max_epi16( _mm_min_epi16( values[0], values[1] ), _mm_min_epi16( values[2], values[3] ) );
+                __m128i hi = _mm_min_epi16( _mm_max_epi16( values[0], values[1] ), _mm_max_epi16( values[2], values[3] ) );
+                median = median3Sse2( values[4], lo, hi );
+            }
+            _mm_storeu_si128( (__m128i *)( filtered + x ), _mm_xor_si128( median, bias ) );
+        }
+        return x;
+    }
+#endif
+
+#if defined( CI_OPENNI_AVX2 )
+    CI_OPENNI_TARGET( "avx2" )
+    static int averageRowAvx2( const uint16_t *depth, uint16_t *filtered, int count, int weight, uint16_t threshold )
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i weights = _mm256_set1_epi16( (short)( weight << 8 ) );
+        const __m256i thresholds = _mm256_set1_epi16( (short)threshold );
+        int x = 0;
+
+        for ( ; x + 16 <= count; x += 16 ) {
+            __m256i d = _mm256_loadu_si256( (const __m256i *)( depth + x ) );
+            __m256i f = _mm256_loadu_si256( (const __m256i *)( filtered + x ) );
+            __m256i up = _mm256_subs_epu16( d, f );
+            __m256i difference = _mm256_or_si256( up, _mm256_subs_epu16( f, d ) );
+            __m256i step = _mm256_mulhi_epu16( difference, weights );
+
+            __m256i isDown = _mm256_cmpeq_epi16( up, zero );
+            __m256i moved = _mm256_blendv_epi8( _mm256_add_epi16( f, step ), _mm256_sub_epi16( f, step ), isDown );
+
+            __m256i isSmall = _mm256_cmpeq_epi16( _mm256_subs_epu16( difference, thresholds ), zero );
+            __m256i isInvalid = _mm256_or_si256( _mm256_cmpeq_epi16( d, zero ), _mm256_cmpeq_epi16( f, zero ) );
+            __m256i keep = _mm256_andnot_si256( isInvalid, isSmall );
+            _mm256_storeu_si256( (__m256i *)( filtered + x ), _mm256_blendv_epi8( d, moved, keep ) );
+        }
+        return x;
+    }
+
+    CI_OPENNI_TARGET( "avx2" )
+    static inline __m256i median3Avx2( __m256i a, __m256i b, __m256i c )
+    {
+        return _mm256_max_epu16( _mm256_min_epu16( a, b ), _mm256_min_epu16( _mm256_max_epu16( a, b ), c ) );
+    }
+
+    CI_OPENNI_TARGET( "avx2" )
+    static int medianRowAvx2( uint16_t *const *history, int frames, int newest, const uint16_t *depth, uint16_t *filtered,
+                              int count, uint16_t threshold )
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i thresholds = _mm256_set1_epi16( (short)threshold );
+        int x = 0;
+
+        for ( ; x + 16 <= count; x += 16 ) {
+            __m256i d = _mm256_loadu_si256( (const __m256i *)( depth + x ) );
+            __m256i f = _mm256_loadu_si256( (const __m256i *)( filtered + x ) );
+            __m256i difference = _mm256_or_si256( _mm256_subs_epu16( d, f ), _mm256_subs_epu16( f, d ) );
+            __m256i isSmall = _mm256_cmpeq_epi16( _mm256_subs_epu16( difference, thresholds ), zero );
+            __m256i isInvalid = _mm256_or_si256( _mm256_cmpeq_epi16( d, zero ), _mm256_cmpeq_epi16( f, zero ) );
+            __m256i stays = _mm256_or_si256( isInvalid, isSmall );
+
+            __m256i values[TemporalDepthFilter::MAX_MEDIAN_FRAMES];
+            for ( int i = 0; i < frames; ++i ) {
+                __m256i h = d;
+                if ( i != newest ) h = _mm256_blendv_epi8( d, _mm256_loadu_si256( (const __m256i *)( history[i] + x ) ), stays );
+                _mm256_storeu_si256( (__m256i *)( history[i] + x ), h );
+                values[i] = h;
+            }
+
+            __m256i median;
+            if ( frames == 3 ) {
+                median = median3Avx2( values[0], values[1], values[2] );
+            }
+            else {
+                __m256i lo = _mm256_max_epu16( _mm256_min_epu16( values[0], values[1] ), _mm256_min_epu16( values[2], values[3] ) );
+                __m256i hi = _mm256_min_epu16( _mm256_max_epu16( values[0], values[1] ), _mm256_max_epu16( values[2], values[3] ) );
+                median = median3Avx2( values[4], lo, hi );
+            }
+            _mm256_storeu_si256( (__m256i *)( filtered + x ), median );
+        }
+        return x;
+    }
+#endif
+
+    TemporalDepthFilter::TemporalDepthFilter() :
+    mode( TEMPORAL_AVERAGE ),
+    averageWeight( 64 ),
+    medianFrames( 3 ),
+    resetThreshold( 100 ),
+    width( 0 ),
+    height( 0 ),
+    hasHistory( false ),
+    historyNewest( 0 )
+    {
+    }
+
+    void TemporalDepthFilter::setMode( int _mode )
+    {
+        if ( mode == _mode ) return;
+        mode = _mode;
+        hasHistory = false;
+    }
+
+    void TemporalDepthFilter::setAverageWeight( float weight )
+    {
+        int value = (int)( weight * 256.0f + 0.5f );
+        averageWeight = value < 1 ? 1 : value > 256 ? 256 : value;
+    }
+
+    void TemporalDepthFilter::setMedianFrames( int frames )
+    {
+        frames = frames > 3 ? MAX_MEDIAN_FRAMES : 3;
+        if ( medianFrames == frames ) return;
+        medianFrames = frames;
+        hasHistory = false;
+    }
+
+    void TemporalDepthFilter::averageRowScalar( const uint16_t *depth, uint16_t *filtered, int count, int weight, uint16_t threshold )
+    {
+        for ( int x = 0; x < count; ++x ) {
+            int d = depth[x], f = filtered[x];
+            int difference = d > f ? d - f : f - d;
+            if ( d == 0 || f == 0 || difference > threshold ) {
+                filtered[x] = (uint16_t)d;
+                continue;
+            }
+            int step = ( difference * weight ) >> 8;
+            filtered[x] = (uint16_t)( d > f ? f + step : f - step );
+        }
+    }
+
+    void TemporalDepthFilter::averageRow( const uint16_t *depth, uint16_t *filtered, int count, int weight, uint16_t threshold )
+    {
+        int x = 0;
+        // the SIMD kernels scale by weight in a 16 bit multiply, a full
+        // weight is a plain copy anyway
+        if ( weight < 256 ) {
+#if defined( CI_OPENNI_AVX2 )
+            if ( getSimdLevel() >= SIMD_AVX2 ) x = averageRowAvx2( depth, filtered, count, weight, threshold );
+            else
+#endif
+#if defined( CI_OPENNI_X86 )
+            if ( getSimdLevel() >= SIMD_SSE2 ) x = averageRowSse2( depth, filtered, count, weight, threshold );
+#endif
+        }
+        averageRowScalar( depth + x, filtered + x, count - x, weight, threshold );
+    }
+
+    void TemporalDepthFilter::medianRowScalar( uint16_t *const *history, int frames, int newest, const uint16_t *depth, uint16_t *filtered,
+                                               int count, uint16_t threshold )
+    {
+        for ( int x = 0; x < count; ++x ) {
+            int d = depth[x], f = filtered[x];
+            int difference = d > f ? d - f : f - d;
+            if ( d != 0 && f != 0 && difference > threshold ) {
+                for ( int i = 0; i < frames; ++i ) history[i][x] = (uint16_t)d;
+            }
+            else {
+                history[newest][x] = (uint16_t)d;
+            }
+
+            filtered[x] = frames == 3 ? median3( history[0][x], history[1][x], history[2][x] )
+                                      : median5( history[0][x], history[1][x], history[2][x], history[3][x], history[4][x] );
+        }
+    }
+
+    void TemporalDepthFilter::medianRow( uint16_t *const *history, int frames, int newest, const uint16_t *depth, uint16_t *filtered,
+                                         int count, uint16_t threshold )
+    {
+        int x = 0;
+#if defined( CI_OPENNI_AVX2 )
+        if ( getSimdLevel() >= SIMD_AVX2 ) x = medianRowAvx2( history, frames, newest, depth, filtered, count, threshold );
+        else
+#endif
+#if defined( CI_OPENNI_X86 )
+        if ( getSimdLevel() >= SIMD_SSE2 ) x = medianRowSse2( history, frames, newest, depth, filtered, count, threshold );
+#endif
+        if ( x == count ) return;
+
+        uint16_t *tails[MAX_MEDIAN_FRAMES];
+        for ( int i = 0; i < frames; ++i ) tails[i] = history[i] + x;
+        medianRowScalar( tails, frames, newest, depth + x, filtered + x, count - x, threshold );
+    }
+
+    void TemporalDepthFilter::filterRows( const uint16_t *depth, int strideInBytes, int beginRow, int endRow )
+    {
+        uint16_t threshold = resetThreshold != 0 ? resetThreshold : 0xFFFF;
+        size_t planeSize = (size_t)width * height;
+
+        for ( int y = beginRow; y < endRow; ++y ) {
+            const uint16_t *row = (const uint16_t *)( (const uint8_t *)depth + y * strideInBytes );
+            uint16_t *filteredRow = &filtered[y * width];
+
+            if ( mode == TEMPORAL_MEDIAN ) {
+                uint16_t *historyRows[MAX_MEDIAN_FRAMES];
+                for ( int i = 0; i < medianFrames; ++i ) historyRows[i] = &history[i * planeSize + y * width];
+                medianRow( historyRows, medianFrames, historyNewest, row, filteredRow, width, threshold );
+            }
+            else {
+                averageRow( row, filteredRow, width, averageWeight, threshold );
+            }
+        }
+    }
+
+    void TemporalDepthFilter::apply( const uint16_t *depth, int strideInBytes, int _width, int _height, RowExecutor *executor )
+    {
+        if ( strideInBytes == 0 ) strideInBytes = _width * sizeof( uint16_t );
+        if ( width != _width || height != _height ) {
+            width = _width;
+            height = _height;
+            filtered.resize( (size_t)width * height );
+            hasHistory = false;
+        }
+
+        size_t planeSize = (size_t)width * height;
+        if ( mode == TEMPORAL_MEDIAN && history.size() < planeSize * medianFrames ) {
+            history.resize( planeSize * medianFrames );
+            hasHistory = false;
+        }
+
+        if ( !hasHistory ) {
+            // start over from this frame
+            int planes = mode == TEMPORAL_MEDIAN ? medianFrames : 0;
+            for ( int y = 0; y < height; ++y ) {
+                const uint16_t *row = (const uint16_t *)( (const uint8_t *)depth + y * strideInBytes );
+                std::memcpy( &filtered[y * width], row, width * sizeof( uint16_t ) );
+                for ( int i = 0; i < planes; ++i ) std::memcpy( &history[i * planeSize + y * width], row, width * sizeof( uint16_t ) );
+            }
+            historyNewest = 0;
+            hasHistory = true;
+            return;
+        }
+
+        if ( mode == TEMPORAL_MEDIAN ) historyNewest = ( historyNewest + 1 ) % medianFrames;
+
+        // one reference to capture keeps the task small enough for
+        // std::function to hold it without allocating
+        struct Frame {
+            TemporalDepthFilter *filter;
+            const uint16_t *depth;
+            int strideInBytes;
+        } frame = { this, depth, strideInBytes };
+        auto rows = [&frame] ( int begin, int end ) { frame.filter->filterRows( frame.depth, frame.strideInBytes, begin, end ); };
+
+        if ( executor != NULL ) executor->run( height, rows );
+        else rows( 0, height );
+    }
+} }
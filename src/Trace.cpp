@@ -0,0 +1,183 @@
+#include "CinderOpenNI/Trace.h"
+
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+#if defined( _MSC_VER )
+#   define CI_OPENNI_THREAD_LOCAL __declspec( thread )
+#else
+#   define CI_OPENNI_THREAD_LOCAL __thread
+#endif
+
+#if defined( _WIN32 )
+#   define WIN32_LEAN_AND_MEAN
+#   define NOMINMAX
+#   include <windows.h>
+#else
+#   include <pthread.h>
+#endif
+
+namespace cinder { namespace openni {
+    struct TraceEvent {
+        const char *name;
+        uint64_t start, duration;
+    };
+
+    // Only ever appended to by its own thread; once full, further events
+    // are dropped rather than overwriting ones a writer may be reading.
+    struct ThreadBuffer {
+        enum { CAPACITY = 1 << 15 };
+
+        ThreadBuffer( int threadId ) : threadId( threadId ), name( NULL ), count( 0 ), isInUse( true ) {}
+
+        int threadId;
+        std::atomic< const char * > name;
+        TraceEvent events[CAPACITY];
+        std::atomic< uint32_t > count;
+        //! false once its thread exited, guarded by buffersMutex
+        bool isInUse;
+    };
+
+    std::atomic< bool > Trace::enabled( false );
+
+    // Buffers outlive their threads, so events of finished threads still get
+    // written. The next new thread reuses the buffer and drops them, which
+    // keeps threads that come and go (capture restarts) from piling up
+    // buffers.
+    static std::mutex buffersMutex;
+    static std::vector< ThreadBuffer * > buffers;
+    static int nextThreadId = 1;
+    static CI_OPENNI_THREAD_LOCAL ThreadBuffer *threadBuffer = NULL;
+
+    // Called by the OS as a thread that used its buffer exits.
+#if defined( _WIN32 )
+    static void WINAPI releaseThreadBuffer( void *buffer )
+#else
+    static void releaseThreadBuffer( void *buffer )
+#endif
+    {
+        if ( buffer == NULL ) return;
+
+        std::lock_guard< std::mutex > lock( buffersMutex );
+        ( (ThreadBuffer *)buffer )->isInUse = false;
+        // still on the exiting thread, later exit handlers that trace get
+        // a buffer of their own
+        threadBuffer = NULL;
+    }
+
+#if defined( _WIN32 )
+    static DWORD createExitKey()
+    {
+        return FlsAlloc( releaseThreadBuffer );
+    }
+    static const DWORD exitKey = createExitKey();
+#else
+    static pthread_key_t createExitKey()
+    {
+        pthread_key_t key;
+        pthread_key_create( &key, releaseThreadBuffer );
+        return key;
+    }
+    static const pthread_key_t exitKey = createExitKey();
+#endif
+
+    static ThreadBuffer & getThreadBuffer()
+    {
+        if ( threadBuffer == NULL ) {
+            std::lock_guard< std::mutex > lock( buffersMutex );
+            for ( auto buffer : buffers ) {
+                if ( buffer->isInUse ) continue;
+
+                buffer->threadId = nextThreadId++;
+                buffer->name.store( NULL, std::memory_order_relaxed );
+                buffer->count.store( 0, std::memory_order_relaxed );
+                buffer->isInUse = true;
+                threadBuffer = buffer;
+                break;
+            }
+            if ( threadBuffer == NULL ) {
+                threadBuffer = new ThreadBuffer( nextThreadId++ );
+                buffers.push_back( threadBuffer );
+            }
+#if defined( _WIN32 )
+            FlsSetValue( exitKey, threadBuffer );
+#else
+            pthread_setspecific( exitKey, threadBuffer );
+#endif
+        }
+        return *threadBuffer;
+    }
+
+    void Trace::setEnabled( bool _enabled )
+    {
+        enabled.store( _enabled, std::memory_order_relaxed );
+    }
+
+    void Trace::setThreadName( const char *name )
+    {
+        // Naming is called per frame, don't allocate a buffer until tracing is on.
+        if ( !isEnabled() ) return;
+        getThreadBuffer().name.store( name, std::memory_order_release );
+    }
+
+    void Trace::record( const char *name, uint64_t startUs, uint64_t endUs )
+    {
+        ThreadBuffer &buffer = getThreadBuffer();
+        uint32_t count = buffer.count.load( std::memory_order_relaxed );
+        if ( count >= ThreadBuffer::CAPACITY ) return;
+
+        TraceEvent &event = buffer.events[count];
+        event.name = name;
+        event.start = startUs;
+        event.duration = endUs - startUs;
+        buffer.count.store( count + 1, std::memory_order_release );
+    }
+
+    void Trace::clear()
+    {
+        std::lock_guard< std::mutex > lock( buffersMutex );
+        for ( auto buffer : buffers ) buffer->count.store( 0, std::memory_order_relaxed );
+    }
+
+    static void writeString( std::ostream &out, const char *text )
+    {
+        out << '"';
+        for ( ; *text; ++text ) {
+            if ( *text == '"' || *text == '\\' ) out << '\\';
+            out << *text;
+        }
+        out << '"';
+    }
+
+    bool Trace::write( const std::string &path )
+    {
+        std::ofstream out( path.c_str() );
+        if ( !out ) return false;
+
+        std::lock_guard< std::mutex > lock( buffersMutex );
+        out << "{\"traceEvents\":[";
+        bool isFirst = true;
+        for ( auto buffer : buffers ) {
+            const char *name = buffer->name.load( std::memory_order_acquire );
+            if ( name != NULL ) {
+                out << ( isFirst ? "\n" : ",\n" ) << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buffer->threadId
+                    << ",\"args\":{\"name\":";
+                writeString( out, name );
+                out << "}}";
+                isFirst = false;
+            }
+
+            uint32_t count = buffer->count.load( std::memory_order_acquire );
+            for ( uint32_t i = 0; i < count; ++i ) {
+                const TraceEvent &event = buffer->events[i];
+                out << ( isFirst ? "\n" : ",\n" ) << "{\"ph\":\"X\",\"name\":";
+                writeString( out, event.name );
+                out << ",\"pid\":1,\"tid\":" << buffer->threadId << ",\"ts\":" << event.start << ",\"dur\":" << event.duration << "}";
+                isFirst = false;
+            }
+        }
+        out << "\n]}\n";
+        return (bool)out;
+    }
+} }